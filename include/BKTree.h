@@ -0,0 +1,54 @@
+/**
+ * @file BKTree.h
+ * @brief Declares a BK-tree over 64-bit perceptual hashes for near-duplicate lookups.
+ *
+ * A BK-tree indexes points of a discrete metric space (here, Hamming distance
+ * between hashes). Every child edge is labeled with its distance to the parent,
+ * so the triangle inequality tells a range search which edges can be skipped.
+ */
+
+ #ifndef BK_TREE_H
+ #define BK_TREE_H
+
+ #include "HugePages.h"
+ #include "ImageUtils.h"
+ #include <cstdint>
+ #include <vector>
+ #include <utility>
+
+ /**
+  * @struct BKNode
+  * @brief A node of the BK-tree, holding one hash and its document.
+  */
+ struct BKNode {
+     uint64_t hash;
+     Document doc;
+     std::vector<std::pair<int, int>> children; ///< (distance to this node, child node index).
+
+     BKNode(uint64_t h, Document d) : hash(h), doc(std::move(d)) {}
+ };
+
+ /**
+  * @class BKTree
+  * @brief Exact Hamming range search over perceptual hashes.
+  */
+ class BKTree {
+ private:
+     HugePageVector<BKNode> nodes; // nodes[0] is the root.
+
+ public:
+     /// Number of differing bits between two hashes.
+     static int hammingDistance(uint64_t a, uint64_t b) { return __builtin_popcountll(a ^ b); }
+
+     void insert(uint64_t hash, const Document& d);
+
+     /**
+      * @brief Finds every document whose hash is within maxDistance bits of hash.
+      * @return The matching documents, nearest first.
+      */
+     std::vector<Document> searchWithin(uint64_t hash, int maxDistance) const;
+
+     size_t size() const { return nodes.size(); }
+ };
+
+ #endif // BK_TREE_H
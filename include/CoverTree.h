@@ -0,0 +1,86 @@
+/**
+ * @file CoverTree.h
+ * @brief Declares a simplified cover tree index for exact K-nearest neighbor search.
+ *
+ * The cover tree only relies on the metric (Euclidean distance), not on the
+ * coordinates, so its search cost depends on the intrinsic dimension of the data
+ * rather than on the 24 histogram coordinates. Nodes live in a flat array and
+ * refer to each other by index, which is also the layout written by save().
+ */
+
+ #ifndef COVER_TREE_H
+ #define COVER_TREE_H
+
+ #include "DataStructures.h"
+ #include "HugePages.h"
+ #include "InterleavedSearch.h"
+ #include <vector>
+ #include <string>
+ #include <queue>
+
+ /**
+  * @struct CoverNode
+  * @brief A node of the cover tree. Every node holds exactly one document.
+  */
+ struct CoverNode {
+     int doc;                    ///< Index of the node's document in CoverTree::docs.
+     int level;                  ///< Cover level; the node covers children within 2^level.
+     float maxDist;              ///< Largest distance from this node to any of its descendants.
+     std::vector<int> children;  ///< Indices of the child nodes in CoverTree::nodes.
+
+     CoverNode(int d, int l) : doc(d), level(l), maxDist(0.0f) {}
+ };
+
+ /**
+  * @class CoverTree
+  * @brief Simplified cover tree (Izbicki & Shelton) with incremental insertion.
+  *
+  * Searches are exact: a subtree is pruned only when the triangle inequality,
+  * using the stored maxDist of its root, proves it cannot improve the K best.
+  */
+ class CoverTree {
+ private:
+     std::vector<Document> docs;
+     HugePageVector<CoverNode> nodes;
+     int root = -1;
+
+     struct BatchSearch; // One query of searchBatch, as a resumable state machine.
+
+     static float coverDist(int level);
+     void insertRec(int node, int docIndex, float dist);
+     void searchSimilarRec(int node, float nodeDist, const Document& query, int k, std::priority_queue<DocDist>& best_docs) const;
+
+ public:
+     void insert(const Document& d);
+     std::vector<Document> searchSimilar(const Document& query, int k) const;
+
+     /**
+      * @brief K-NN for many queries, interleaved on one core to overlap their cache misses.
+      *
+      * Expanding a node walks four dependent arrays (node, child indices, child
+      * nodes, child features); each search prefetches one level for all children
+      * and yields to the next. Results are identical to searchSimilar.
+      */
+     std::vector<std::vector<Document>> searchBatch(const std::vector<Document>& queries, int k,
+                                                    int inFlight = INTERLEAVED_SEARCHES) const;
+
+     size_t size() const { return docs.size(); }
+
+     /**
+      * @brief Writes the tree to a single binary file with a flat layout.
+      *
+      * The file contains a header, a fixed-size record per node with the
+      * children stored as one contiguous index array, the row-major feature
+      * matrix and finally the ids and filenames.
+      * @return true on success, false if the file could not be written.
+      */
+     bool save(const std::string& path) const;
+
+     /**
+      * @brief Replaces the current contents with a tree previously written by save().
+      * @return true on success, false if the file is missing or malformed.
+      */
+     bool load(const std::string& path);
+ };
+
+ #endif // COVER_TREE_H
@@ -7,11 +7,19 @@
  #define DATA_STRUCTURES_H
  
  #include "ImageUtils.h"
+ #include "FeatureBlocks.h"
+ #include "InterleavedSearch.h"
  #include <vector>
  #include <map>
  #include <random>
  #include <queue> // Required for priority_queue
  
+ /**
+  * @brief Default seed of every randomized structure (LSH projections, randomized
+  * trees, k-means initialization), so that repeated runs are bit-identical.
+  */
+ const unsigned DEFAULT_RANDOM_SEED = 20252;
+ 
  //=============================================================================
  // Helper Structure for KNN Search
  //=============================================================================
@@ -39,10 +47,25 @@
  class DocumentList {
  private:
      std::vector<Document> docs;
+     FeatureBlocks blocks; // The features of docs, in the same order, for the blocked scan.
+     Metric metric;
  
  public:
+     explicit DocumentList(Metric m = Metric::Euclidean) : metric(m) {}
      void insert(const Document& d);
+     /// Removes the document with the given id (the last document takes its place). @return false if it is not stored.
+     bool remove(int id);
      std::vector<Document> searchSimilar(const Document& query, int k);
+
+     /**
+      * @brief K-NN for many queries at once, through the norm-decomposed batched kernel.
+      *
+      * The decomposed distances only select candidates: every document that its
+      * error bound leaves in reach of the k-th nearest is re-ranked with the
+      * kernel of searchSimilar, so the results are identical to it.
+      * Manhattan lists answer each query with searchSimilar.
+      */
+     std::vector<std::vector<Document>> searchBatch(const std::vector<Document>& queries, int k);
  };
  
  //=============================================================================
@@ -52,43 +75,120 @@
      Document doc;
      KdNode *left = nullptr;
      KdNode *right = nullptr;
+     bool deleted = false; // Tombstone: the node still splits space but is never returned.
  
      KdNode(Document d) : doc(std::move(d)) {}
      ~KdNode() { delete left; delete right; }
  };
+
+ /// Queries per searchPacket group: one AVX register of float plane tests.
+ const int KD_PACKET_SIZE = 8;
  
  class KdTree {
  private:
      KdNode* root = nullptr;
      int k; // The dimensionality of the feature space.
+     Metric metric; // The splitting planes bound both L1 and L2 distances, so either prunes correctly.
+     size_t liveCount = 0;
+     size_t deletedCount = 0;
  
+     struct BatchSearch; // One query of searchBatch, as a resumable state machine.
+     struct Packet;      // The queries of one searchPacket group and their K best.
+
      void insertRec(KdNode*& node, Document d, int depth);
      void searchSimilarRec(KdNode* node, const Document& query, int k, std::priority_queue<DocDist>& best_docs, int depth) const;
+     void searchPacketRec(const KdNode* node, int depth, unsigned mask, Packet& packet) const;
  
  public:
-     KdTree(int dimensions) : k(dimensions) {}
+     KdTree(int dimensions, Metric m = Metric::Euclidean) : k(dimensions), metric(m) {}
      ~KdTree() { delete root; }
  
      void insert(const Document& d);
-     std::vector<Document> searchSimilar(const Document& query, int k);
+ 
+     /**
+      * @brief Removes a document by marking its node deleted (a tombstone).
+      * @param d The stored document; its features locate the node and its id identifies it.
+      * @return false if the document is not stored.
+      */
+     bool remove(const Document& d);
+     std::vector<Document> searchSimilar(const Document& query, int k) const;
+
+     /**
+      * @brief K-NN for many queries, interleaved on one core to overlap their cache misses.
+      *
+      * Each search runs searchSimilar's traversal from an explicit stack and
+      * yields after prefetching the next node (and again after prefetching its
+      * features), so up to inFlight node misses are outstanding at once. The
+      * results are identical to calling searchSimilar for every query.
+      */
+     std::vector<std::vector<Document>> searchBatch(const std::vector<Document>& queries, int k,
+                                                    int inFlight = INTERLEAVED_SEARCHES) const;
+
+     /**
+      * @brief K-NN for many queries by packet traversal: groups of KD_PACKET_SIZE
+      * queries descend the tree together.
+      *
+      * Every node is loaded once per group and its plane is tested for the whole
+      * group with one vector compare, against a per-query pruning bound; a bit
+      * mask tracks which queries are still active in a subtree. A node's children
+      * are visited in up to three passes (left for the queries whose near side is
+      * left, right for the right-near queries plus the left-near ones that cannot
+      * prune it, left again for the remaining right-near ones), so every query
+      * sees the same visits in the same order as in searchSimilar and the results
+      * are identical to it.
+      */
+     std::vector<std::vector<Document>> searchPacket(const std::vector<Document>& queries, int k) const;
+ 
+     size_t size() const { return liveCount; }
+     size_t removedCount() const { return deletedCount; } ///< Tombstones; rebuild the tree once they dominate.
  };
  
  //=============================================================================
  // 3. Hashing Structure (Locality-Sensitive Hashing)
  //=============================================================================
+ 
+ /**
+  * @enum HashFamily
+  * @brief The LSH function family used by DocumentHash.
+  */
+ enum class HashFamily {
+     GaussianProjection, ///< p-stable projection: floor(a.x / w).
+     E2LSH,              ///< p-stable projection with a random offset: floor((a.x + b) / w), b ~ U[0, w).
+     CrossPolytope       ///< Closest signed axis after a pseudo-random rotation (angular LSH; ignores the width).
+ };
+ 
+ /**
+  * @struct HashBucket
+  * @brief The documents sharing one LSH key, with their features blocked for re-ranking.
+  */
+ struct HashBucket {
+     std::vector<Document> docs;
+     FeatureBlocks blocks;
+ };
+ 
  class DocumentHash {
  private:
-     std::map<std::vector<int>, std::vector<Document>> buckets;
+     std::map<std::vector<int>, HashBucket> buckets;
      std::vector<std::vector<float>> projections;
+     std::vector<float> offsets;                // E2LSH: one offset b per hash.
+     std::vector<std::vector<float>> rotations; // Cross-polytope: random signs of the 3 HD rounds per hash.
+     HashFamily family;
+     int paddedDims; // Cross-polytope: dimensions rounded up to a power of two.
      float bucketWidth;
      int numHashes;
  
      std::vector<int> getHashKey(const std::vector<float>& features) const;
  
  public:
-     DocumentHash(int dimensions, int nHashes, float width);
+     DocumentHash(int dimensions, int nHashes, float width, HashFamily hashFamily = HashFamily::GaussianProjection,
+                  unsigned seed = DEFAULT_RANDOM_SEED);
      void insert(const Document& d);
-     std::vector<Document> searchSimilar(const Document& query, int k);
+     /// Removes a stored document (located by its features, matched by id). @return false if absent.
+     bool remove(const Document& d);
+     std::vector<Document> searchSimilar(const Document& query, int k) const;
+ 
+     /// Number of documents sharing the query's bucket, i.e. the candidates a search re-ranks.
+     size_t candidateCount(const Document& query) const;
  };
  
  #endif //DATA_STRUCTURES_H
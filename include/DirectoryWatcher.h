@@ -0,0 +1,78 @@
+/**
+ * @file DirectoryWatcher.h
+ * @brief Declares an inotify-based watcher that reports image files as they change.
+ */
+
+ #ifndef DIRECTORY_WATCHER_H
+ #define DIRECTORY_WATCHER_H
+
+ #include <cstdint>
+ #include <string>
+ #include <unordered_map>
+ #include <vector>
+
+ /**
+  * @struct FileEvent
+  * @brief The net change of one file over a batch of notifications.
+  */
+ struct FileEvent {
+     enum class Type {
+         Changed, ///< Created, rewritten or moved into the directory.
+         Removed  ///< Deleted or moved out of the directory.
+     };
+     Type type;
+     std::string path;
+ };
+
+ /**
+  * @class DirectoryWatcher
+  * @brief Watches one directory (not recursively) for finished writes, renames and deletions.
+  *
+  * If the kernel queue overflows, notifications are lost; the next poll() then
+  * rescans the directory and reports every file added, removed or rewritten
+  * (by size or modification time) since it was last reported.
+  */
+ class DirectoryWatcher {
+ private:
+     int fd = -1;
+     std::string directory;
+     std::vector<char> buffer; // Raw inotify records.
+     bool overflowed = false;
+
+     // Size and modification time (ns) of each file as of its last report.
+     std::unordered_map<std::string, std::pair<uint64_t, int64_t>> known;
+
+     // Merges a change into the batch; later changes of a path replace earlier ones.
+     static void record(std::vector<FileEvent>& events, std::unordered_map<std::string, size_t>& index,
+                        FileEvent::Type type, std::string path);
+
+     // Lists the directory and records every difference from known.
+     void rescan(std::vector<FileEvent>& events, std::unordered_map<std::string, size_t>& index);
+
+     // Reads the pending records into the per-path net changes; index maps a path
+     // to its position in events. @return false on a read error.
+     bool drain(std::vector<FileEvent>& events, std::unordered_map<std::string, size_t>& index);
+
+ public:
+     DirectoryWatcher() = default;
+     ~DirectoryWatcher();
+     DirectoryWatcher(const DirectoryWatcher&) = delete;
+     DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+     /// Starts watching a directory. @return false if inotify is unavailable or the directory is missing.
+     bool start(const std::string& dir);
+
+     /// Stops watching; pending notifications are discarded.
+     void stop();
+
+     /**
+      * @brief Waits for changes and returns them coalesced per file, in first-seen order.
+      * @param waitMs Maximum time to wait for the first notification; 0 returns immediately.
+      * @param batchMs Once something changed, how long to keep collecting related
+      * notifications (e.g. the several writes of one copy) before returning.
+      * @return An empty batch if nothing changed within waitMs.
+      */
+     std::vector<FileEvent> poll(int waitMs, int batchMs);
+ };
+
+ #endif // DIRECTORY_WATCHER_H
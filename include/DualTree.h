@@ -0,0 +1,84 @@
+/**
+ * @file DualTree.h
+ * @brief Declares exact dual-tree K-NN between a query set and a corpus.
+ *
+ * Answering a large query set (all-vs-all evaluation, bulk de-duplication) with
+ * one tree search per query repeats the same work for neighbouring queries: they
+ * descend the same branches and are pruned by the same planes. A dual-tree search
+ * also builds a tree over the queries and recurses on pairs of nodes, so one
+ * box-to-box bound can discard a whole corpus subtree for a whole group of
+ * queries at once (Gray & Moore; Curtin et al.).
+ */
+
+ #ifndef DUAL_TREE_H
+ #define DUAL_TREE_H
+
+ #include "DataStructures.h"
+ #include "HugePages.h"
+ #include <cstdint>
+ #include <vector>
+
+ /**
+  * @struct BoxTree
+  * @brief A bulk-built kd-tree with bounding boxes and the points stored in leaf order.
+  *
+  * Nodes split their points at the median of the box's widest dimension until at
+  * most leafSize remain. Leaves have left == right == -1; every node owns the
+  * points [begin, begin + count).
+  */
+ struct BoxTree {
+     struct Node {
+         int32_t left;
+         int32_t right;
+         uint32_t begin;
+         uint32_t count;
+     };
+
+     int dims = 0;
+     std::vector<Node> nodes;        // nodes[0] is the root.
+     HugePageVector<float> boxes;    // Per node: dims lower bounds, then dims upper bounds.
+     HugePageVector<float> points;   // Row-major features, in leaf order.
+     std::vector<uint32_t> original; // Position in the input of every point, in leaf order.
+
+     void build(const std::vector<Document>& docs, int leafSize);
+
+     const float* lower(int node) const { return &boxes[(size_t)node * 2 * dims]; }
+     const float* upper(int node) const { return &boxes[((size_t)node * 2 + 1) * dims]; }
+     const float* point(uint32_t position) const { return &points[(size_t)position * dims]; }
+     bool isLeaf(int node) const { return nodes[node].left == -1; }
+ };
+
+ /**
+  * @class DualTreeKnn
+  * @brief Exact Euclidean K-NN of a whole query set by dual-tree traversal.
+  *
+  * A pair (query node, corpus node) is pruned when the distance between the two
+  * boxes exceeds the largest K-th best distance among the node's queries. The
+  * work is split over subtrees of the query tree, which own disjoint queries, so
+  * the threads share nothing but the read-only corpus tree.
+  */
+ class DualTreeKnn {
+ private:
+     std::vector<Document> docs;
+     BoxTree corpus;
+     int leafSize;
+
+ public:
+     explicit DualTreeKnn(int leafSize = 16) : leafSize(leafSize) {}
+
+     /// Builds the corpus tree over the given documents, replacing the previous corpus.
+     void build(const std::vector<Document>& corpusDocs);
+
+     /**
+      * @brief The k nearest corpus documents of every query, nearest first.
+      *
+      * Distances are computed as in euclideanDistance, so the neighbours match
+      * searchSimilar of the other exact structures up to the order of equal distances.
+      * @param numThreads Worker threads to use; 0 uses all hardware threads.
+      */
+     std::vector<std::vector<Document>> search(const std::vector<Document>& queries, int k, int numThreads = 0) const;
+
+     size_t size() const { return docs.size(); }
+ };
+
+ #endif // DUAL_TREE_H
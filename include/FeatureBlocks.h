@@ -0,0 +1,93 @@
+/**
+ * @file FeatureBlocks.h
+ * @brief Declares a blocked (AoSoA) feature layout for evaluating many distances at once.
+ *
+ * Computing one 24-d distance at a time ends every vector in a horizontal
+ * reduction. Here features are stored in blocks of LANES documents, transposed
+ * per dimension: dimension j of the block's documents is LANES consecutive
+ * floats. A kernel then keeps one accumulator per document in a vector register
+ * and computes LANES distances with purely vertical subtract/multiply/add.
+ *
+ * For batches of queries the squared distance is decomposed as
+ * |q - x|^2 = |q|^2 + |x|^2 - 2 q.x, with |x|^2 stored per document, so the
+ * work becomes a small matrix product evaluated by a register-blocked kernel.
+ */
+
+ #ifndef FEATURE_BLOCKS_H
+ #define FEATURE_BLOCKS_H
+
+ #include "ImageUtils.h" // for Metric
+ #include "HugePages.h"
+ #include <cstddef>
+ #include <vector>
+
+ /// Documents per block: 8 floats fill an AVX register; build with -DFEATURE_BLOCK_LANES=16 for AVX-512.
+ #ifndef FEATURE_BLOCK_LANES
+ #define FEATURE_BLOCK_LANES 8
+ #endif
+
+ /**
+  * @class FeatureBlocks
+  * @brief Feature vectors in blocks of LANES documents, transposed per dimension.
+  *
+  * Element (document i, dimension j) lives at
+  * data[((i / LANES) * dims + j) * LANES + i % LANES]. The unused lanes of the
+  * last block are zero. Documents are addressed by their position, which the
+  * owner keeps parallel to its own document array.
+  */
+ class FeatureBlocks {
+ private:
+     int dims = 0;
+     size_t count = 0;
+     HugePageVector<float> data;
+     HugePageVector<float> norms; // |x|^2 of every document, by position, zero-padded to whole blocks.
+
+ public:
+     static constexpr int LANES = FEATURE_BLOCK_LANES;
+     /// Queries per register tile of the batched kernel (times 2 blocks: 8 accumulators).
+     static constexpr int QUERY_TILE = 4;
+
+     /// The dimensionality is taken from the first appended vector.
+     FeatureBlocks() = default;
+
+     /// Appends a feature vector at position size().
+     void append(const std::vector<float>& features);
+
+     /// Moves the last document into position index and drops the last position.
+     void removeSwap(size_t index);
+
+     void clear();
+
+     /**
+      * @brief Distances from the query to the LANES documents of one block.
+      * @param out LANES results; lanes past size() hold the distance to a zero vector.
+      */
+     void blockDistances(Metric metric, const float* query, size_t block, float* out) const;
+
+     /// Distances from the query to every document, written to out[0 .. size()).
+     void distances(Metric metric, const float* query, float* out) const;
+
+     /**
+      * @brief Squared Euclidean distances from a batch of queries to every document,
+      * by the norm decomposition.
+      *
+      * Like a GEMM, the documents are split into cache-sized chunks and every tile
+      * of QUERY_TILE queries passes over a chunk while it is hot. Each kernel step
+      * loads one dimension of two blocks and multiplies it by the broadcast query
+      * values, so every load feeds QUERY_TILE fused multiply-adds. The result carries cancellation error of order
+      * 1e-7 * (|q|^2 + |x|^2); re-rank the nearest candidates exactly when the
+      * order of near-ties matters.
+      * @param queries nQueries pointers to query vectors of dimensions() floats.
+      * @param out nQueries rows of size() squared distances, clamped at zero.
+      */
+     void batchSquaredDistances(const float* const* queries, int nQueries, float* out) const;
+
+     /// |x|^2 of the document at the given position.
+     float squaredNorm(size_t index) const { return norms[index]; }
+
+     size_t size() const { return count; }
+     size_t blocks() const { return (count + LANES - 1) / LANES; }
+     int dimensions() const { return dims; }
+ };
+
+ #endif // FEATURE_BLOCKS_H
@@ -0,0 +1,113 @@
+/**
+ * @file HugePages.h
+ * @brief Declares huge-page backed allocation for the large feature and index arrays.
+ *
+ * Random accesses into arrays much larger than the last-level cache miss the
+ * TLB as well as the cache: with 4 KB pages a 200 MB feature store spans 50,000
+ * pages, far more than the TLB holds. Backing the same array with 2 MB pages
+ * cuts that to 100 entries. The page size is a runtime policy, so the same
+ * binary can compare the options; by default the system's THP setting decides.
+ */
+
+ #ifndef HUGE_PAGES_H
+ #define HUGE_PAGES_H
+
+ #include <cstddef>
+ #include <new>
+ #include <string>
+ #include <vector>
+
+ /**
+  * @enum PagePolicy
+  * @brief How allocations of at least HUGE_PAGE_SIZE bytes are backed.
+  */
+ enum class PagePolicy {
+     System,      ///< No madvise: /sys/kernel/mm/transparent_hugepage decides (the default).
+     Standard,    ///< 4 KB pages forced with madvise(MADV_NOHUGEPAGE); a benchmark baseline.
+     Transparent, ///< Transparent huge pages requested with madvise(MADV_HUGEPAGE).
+     Explicit     ///< Pre-reserved hugetlbfs pages (MAP_HUGETLB); falls back to Transparent.
+ };
+
+ const size_t HUGE_PAGE_SIZE = 2u << 20;
+
+ /// Sets the policy of subsequent allocations (existing arrays keep their pages).
+ void setPagePolicy(PagePolicy policy);
+ PagePolicy pagePolicy();
+
+ /// Parses "system", "standard", "thp" or "explicit". @return false for anything else.
+ bool parsePagePolicy(const std::string& name, PagePolicy& policy);
+ const char* pagePolicyName(PagePolicy policy);
+
+ /**
+  * @brief Maps bytes (rounded up to HUGE_PAGE_SIZE, 2 MB aligned) under the current policy.
+  * @return nullptr if the memory could not be mapped.
+  */
+ void* allocatePages(size_t bytes);
+
+ /// Unmaps memory returned by allocatePages(bytes).
+ void freePages(void* pointer, size_t bytes);
+
+ /// Bytes of this process currently backed by transparent huge pages (AnonHugePages), or 0.
+ size_t residentHugePageBytes();
+
+ /**
+  * @class HugePageAllocator
+  * @brief STL allocator: blocks of at least HUGE_PAGE_SIZE bytes come from allocatePages().
+  *
+  * Smaller blocks (hash-table nodes, small arrays) use operator new, since a
+  * page-sized mapping per node would waste far more than the TLB saves.
+  */
+ template <class T>
+ struct HugePageAllocator {
+     typedef T value_type;
+
+     HugePageAllocator() = default;
+     template <class U>
+     HugePageAllocator(const HugePageAllocator<U>&) {}
+
+     T* allocate(size_t n) {
+         size_t bytes = n * sizeof(T);
+         if (bytes < HUGE_PAGE_SIZE) return static_cast<T*>(::operator new(bytes));
+         void* pointer = allocatePages(bytes);
+         if (pointer == nullptr) throw std::bad_alloc();
+         return static_cast<T*>(pointer);
+     }
+
+     void deallocate(T* pointer, size_t n) {
+         size_t bytes = n * sizeof(T);
+         if (bytes < HUGE_PAGE_SIZE) ::operator delete(pointer);
+         else freePages(pointer, bytes);
+     }
+
+     template <class U>
+     bool operator==(const HugePageAllocator<U>&) const { return true; }
+     template <class U>
+     bool operator!=(const HugePageAllocator<U>&) const { return false; }
+ };
+
+ template <class T>
+ using HugePageVector = std::vector<T, HugePageAllocator<T>>;
+
+ /**
+  * @class TlbMissCounter
+  * @brief Counts data-TLB read misses of this thread through perf_event_open.
+  *
+  * Unavailable (e.g. perf_event_paranoid too strict, or in a container) when the
+  * counter cannot be opened; stop() then returns -1.
+  */
+ class TlbMissCounter {
+ private:
+     int fd = -1;
+
+ public:
+     TlbMissCounter();
+     ~TlbMissCounter();
+     TlbMissCounter(const TlbMissCounter&) = delete;
+     TlbMissCounter& operator=(const TlbMissCounter&) = delete;
+
+     bool available() const { return fd >= 0; }
+     void start();
+     long long stop();
+ };
+
+ #endif // HUGE_PAGES_H
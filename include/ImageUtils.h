@@ -16,6 +16,9 @@
  #include <string>
  #include <cmath>
  #include <cfloat> // Required for FLT_MAX
+ #include <cstdint>
+ #include <mutex>
+ #include <unordered_map>
  
  // Third-party Includes
  #include <opencv2/opencv.hpp> // Main header for the OpenCV library
@@ -54,8 +57,32 @@
   * @param b The second feature vector.
   * @return The L2 norm (Euclidean distance) between vectors a and b.
   */
+ float euclideanDistance(const float* a, const float* b, size_t n);
  float euclideanDistance(const std::vector<float>& a, const std::vector<float>& b);
  
+ /**
+  * @brief Calculates the L1 (Manhattan) distance between two feature vectors.
+  *
+  * The sum is split over 8 independent accumulators, so the compiler can keep
+  * the loop in vector registers without reassociating a single running sum.
+  */
+ float manhattanDistance(const float* a, const float* b, size_t n);
+ float manhattanDistance(const std::vector<float>& a, const std::vector<float>& b);
+ 
+ /**
+  * @enum Metric
+  * @brief The distance a search structure ranks documents by.
+  */
+ enum class Metric {
+     Euclidean, ///< L2, the default for histogram features.
+     Manhattan  ///< L1; over cumulative histograms (histogramToCdf) it equals the Earth Mover's Distance.
+ };
+ 
+ /// Distance between two feature vectors under the given metric.
+ inline float featureDistance(Metric metric, const std::vector<float>& a, const std::vector<float>& b) {
+     return metric == Metric::Manhattan ? manhattanDistance(a, b) : euclideanDistance(a, b);
+ }
+ 
  /**
   * @brief Extracts a color histogram from an image to serve as its feature vector.
   * @param path The file path to the image.
@@ -64,4 +91,191 @@
   */
  std::vector<float> extractHistogram(const std::string& path);
  
+ const int HISTOGRAM_BINS = 8;                       ///< Bins per color channel.
+ const int HISTOGRAM_SIZE = HISTOGRAM_BINS * 3;      ///< Length of a feature vector.
+ 
+ /**
+  * @brief Computes the normalized, interleaved color histogram of a decoded image.
+  * @param img An 8-bit, 3-channel BGR image.
+  * @param out Destination for HISTOGRAM_SIZE floats, laid out as [B0, G0, R0, B1, ...].
+  */
+ void computeHistogram(const cv::Mat& img, float* out);
+ 
+ /**
+  * @brief Turns a histogram into per-channel cumulative distributions (CDFs).
+  *
+  * For 1-D histograms of equal mass, the Earth Mover's Distance equals the L1
+  * distance between their CDFs. Each channel of the histogram is rescaled to unit
+  * mass and accumulated, so the Manhattan distance between two outputs is the sum
+  * of the per-channel EMDs (in units of one bin). A channel that is all zeros
+  * (equal counts in every bin) is treated as uniform.
+  * @param histogram HISTOGRAM_SIZE floats, as computed by computeHistogram().
+  * @param cdf Destination for HISTOGRAM_SIZE floats in the same interleaved layout.
+  */
+ void histogramToCdf(const float* histogram, float* cdf);
+ 
+ /**
+  * @brief Adds the raw per-channel bin counts of an image (or a band of rows) to counts.
+  * Together with normalizeHistogram() this lets an image be processed in pieces.
+  */
+ void accumulateHistogram(const cv::Mat& img, unsigned counts[3][HISTOGRAM_BINS]);
+ 
+ /// Min-max normalizes raw bin counts into an interleaved feature vector, like computeHistogram().
+ void normalizeHistogram(const unsigned counts[3][HISTOGRAM_BINS], float* out);
+ 
+ /**
+  * @brief Computes a 64-bit difference hash (dHash) of a decoded image.
+  *
+  * The image is reduced to a 9x8 grid of average luminances; bit (row * 8 + col)
+  * is set when cell (row, col) is darker than its right neighbor. Near-identical
+  * images (re-encoded, resized, lightly edited) differ in only a few bits.
+  * @param img An 8-bit, 3-channel BGR image.
+  */
+ uint64_t computeDHash(const cv::Mat& img);
+ 
+ /**
+  * @class DHashBuilder
+  * @brief Computes the same hash as computeDHash() from an image delivered in bands of rows.
+  */
+ class DHashBuilder {
+ private:
+     static const int GRID_ROWS = 8;
+     static const int GRID_COLS = 9;
+     int imageRows = 0, imageCols = 0;
+     uint64_t sums[GRID_ROWS][GRID_COLS]; ///< Weighted luminance sums of each cell.
+ 
+ public:
+     void begin(int rows, int cols);                   ///< Starts an image of the given size.
+     void addRows(const cv::Mat& band, int firstRow);  ///< Adds the rows [firstRow, firstRow + band.rows).
+     uint64_t finish() const;                          ///< Returns the hash once every row was added.
+ };
+ 
+ /**
+  * @class IntegralHistogram
+  * @brief Per-bin summed-area tables of an image at reduced resolution.
+  *
+  * The image is divided into a grid of at most resolution x resolution cells and,
+  * for each of the HISTOGRAM_SIZE (channel, bin) pairs, the table stores the pixel
+  * count of every rectangle anchored at the top-left corner. The histogram of any
+  * rectangle aligned to the grid then costs four lookups per bin, without the
+  * source image. Arbitrary rectangles are snapped to the nearest cell boundaries.
+  */
+ class IntegralHistogram {
+ private:
+     int resolution;
+     int imageRows = 0, imageCols = 0;
+     int gridRows = 0, gridCols = 0;
+     std::vector<unsigned> table; ///< (gridRows + 1) x (gridCols + 1) entries of HISTOGRAM_SIZE counts.
+ 
+     unsigned* cell(int gy, int gx) { return &table[((size_t)gy * (gridCols + 1) + gx) * HISTOGRAM_SIZE]; }
+     const unsigned* cell(int gy, int gx) const { return &table[((size_t)gy * (gridCols + 1) + gx) * HISTOGRAM_SIZE]; }
+ 
+ public:
+     /// @param gridResolution Maximum number of cells along each axis.
+     explicit IntegralHistogram(int gridResolution = 16);
+ 
+     /// Rebuilds the tables from a decoded 8-bit BGR image.
+     void build(const cv::Mat& img);
+ 
+     /// Starts building from an image of the given size that is delivered in bands of rows.
+     void begin(int rows, int cols);
+     /// Adds the rows [firstRow, firstRow + band.rows) of the image started with begin().
+     void addRows(const cv::Mat& band, int firstRow);
+     /// Completes the tables once every row was added.
+     void finish();
+ 
+     /**
+      * @brief Computes the normalized histogram of a region in O(1).
+      * @param region The rectangle, in pixel coordinates of the original image.
+      * @param out Destination for HISTOGRAM_SIZE floats, normalized like computeHistogram().
+      */
+     void regionHistogram(const cv::Rect& region, float* out) const;
+ 
+     /// The histogram of the whole image; identical to computeHistogram().
+     void histogram(float* out) const;
+ 
+     bool empty() const { return table.empty(); }
+     int rows() const { return imageRows; } ///< Height of the source image in pixels.
+     int cols() const { return imageCols; } ///< Width of the source image in pixels.
+ };
+ 
+ /**
+  * @class HistogramExtractor
+  * @brief A reusable histogram extractor, meant to be owned by a single worker thread.
+  *
+  * The extractor keeps its file buffer and decoded image between calls, so once
+  * they have grown to the largest image seen, extracting further images of that
+  * size performs no heap allocations in this code (the image decoder itself may
+  * still allocate internally).
+  */
+ class HistogramExtractor {
+ private:
+     std::vector<unsigned char> fileBuffer; ///< Encoded bytes of the last file read.
+     size_t fileSize = 0;                   ///< Number of valid bytes in fileBuffer.
+     uint64_t fileHash = 0;                 ///< contentHash() of the last file read.
+     cv::Mat decoded;                       ///< Decoded pixels, reused when the size matches.
+ 
+ public:
+     /**
+      * @brief Reads a file into the reusable buffer and hashes its contents,
+      * without decoding it.
+      * @return false if the file could not be read.
+      */
+     bool readFile(const std::string& path);
+ 
+     const unsigned char* buffer() const { return fileBuffer.data(); } ///< Bytes of the last file read.
+     size_t bufferSize() const { return fileSize; }                   ///< Size of the last file read.
+     uint64_t bufferHash() const { return fileHash; }                 ///< Content hash of the last file read.
+     const cv::Mat& image() const { return decoded; }                 ///< Pixels of the last extract().
+ 
+
+     /**
+      * @brief Decodes an encoded image held in memory and computes its histogram.
+      * @param data The encoded bytes (JPEG, PNG, ...). They are not copied.
+      * @param size Number of bytes in data.
+      * @param out Destination for HISTOGRAM_SIZE floats, e.g. a row of a feature matrix.
+      * @param perceptualHash If not null, also receives computeDHash() of the same pixels.
+      * @param integral If not null, is rebuilt from the same pixels for later region queries.
+      * @return false if the bytes could not be decoded.
+      */
+     bool extract(const unsigned char* data, size_t size, float* out, uint64_t* perceptualHash = nullptr,
+                  IntegralHistogram* integral = nullptr);
+ 
+     /**
+      * @brief Reads a file into the reusable buffer and extracts its histogram.
+      * @return false if the file could not be read or decoded.
+      */
+     bool extractFile(const std::string& path, float* out, uint64_t* perceptualHash = nullptr);
+ };
+ 
+ /**
+  * @brief Computes a fast 64-bit content hash (XXH64) of a byte range.
+  * @param data The bytes to hash.
+  * @param size Number of bytes.
+  * @param seed Optional seed; different seeds give independent hashes.
+  * @return The 64-bit hash. Byte-identical inputs always hash to the same value.
+  */
+ uint64_t contentHash(const unsigned char* data, size_t size, uint64_t seed = 0);
+ 
+ /**
+  * @class ContentHashMap
+  * @brief Thread-safe map from file contents to the feature row that holds their histogram.
+  *
+  * Lets ingestion workers skip decoding byte-identical files: the first file with
+  * a given content hash and size claims its row, later ones are linked to that row.
+  */
+ class ContentHashMap {
+ private:
+     struct Entry { uint64_t size; size_t row; };
+     std::unordered_map<uint64_t, Entry> entries;
+     std::mutex lock;
+ 
+ public:
+     /**
+      * @brief Returns the row that already holds content with this hash and size,
+      * or registers row for it and returns row.
+      */
+     size_t findOrInsert(uint64_t hash, uint64_t size, size_t row);
+ };
+ 
  #endif // IMAGE_UTILS_H
\ No newline at end of file
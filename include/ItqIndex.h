@@ -0,0 +1,86 @@
+/**
+ * @file ItqIndex.h
+ * @brief Declares Iterative Quantization (ITQ) binary codes and a Hamming-scan index.
+ *
+ * Random projections (DocumentHash) spend many bits on directions the strongly
+ * correlated histogram bins barely vary in. ITQ (Gong & Lazebnik) first projects
+ * the centered features onto their top principal components, then learns an
+ * orthogonal rotation that minimizes the quantization error of taking signs, so
+ * every bit of the code carries balanced, decorrelated information.
+ */
+
+ #ifndef ITQ_INDEX_H
+ #define ITQ_INDEX_H
+
+ #include "DataStructures.h"
+ #include "HugePages.h"
+ #include "MultiIndexHash.h"
+ #include <cstdint>
+ #include <memory>
+ #include <vector>
+
+ /**
+  * @class ItqIndex
+  * @brief Binary codes learned with ITQ, searched by a popcount scan and exact re-ranking.
+  *
+  * Usage: train() on a representative sample (e.g. all documents), insert() the
+  * documents, then searchSimilar(). Codes are packed into codeBytes() bytes each.
+  * Candidates come from a linear popcount scan, or from multi-index hashing once
+  * useMultiIndex() is called.
+  */
+ class ItqIndex {
+ private:
+     int dims;
+     int numBits;
+     int iterations;
+     unsigned seed;
+     bool trained = false;
+
+     std::vector<float> mean;       // dims
+     std::vector<float> projection; // numBits rows of dims: the PCA basis rotated by the learned R.
+     HugePageVector<uint8_t> codes; // Packed codes, codeBytes() per document, plus 8 bytes of padding.
+     std::vector<Document> docs;
+     std::unique_ptr<MultiIndexHash> multiIndex; // Optional sub-linear candidate generator.
+
+     uint64_t loadCode(size_t index) const;
+     /// Popcount scan: appends the candidates closest in Hamming distance, with their exact distances.
+     void scanCandidates(uint64_t code, size_t candidates, const Document& query, std::vector<DocDist>& ranked) const;
+
+ public:
+     /**
+      * @param dimensions Dimensionality of the feature vectors.
+      * @param nBits Code length; at most min(dimensions, 64), since PCA yields one bit per component.
+      * @param nIterations Rotation refinement steps (50 is usually converged).
+      * @param randomSeed Seed of the initial random rotation.
+      */
+     ItqIndex(int dimensions, int nBits, int nIterations = 50, unsigned randomSeed = DEFAULT_RANDOM_SEED);
+
+     /// Learns the mean, PCA basis and rotation. @return false if there are fewer than two documents.
+     bool train(const std::vector<Document>& sample);
+
+     /// The packed code of a feature vector (bit j of the result is bit j of the code).
+     uint64_t encode(const std::vector<float>& features) const;
+
+     /// Encodes and stores a document; train() must have been called.
+     void insert(const Document& d);
+
+     /**
+      * @brief Generates candidates by multi-index hashing instead of the linear scan.
+      * @param substrings Number of tables; 0 picks bits / log2(n) for the current size.
+      * Both generators return the same Hamming-nearest candidates, up to ties.
+      */
+     void useMultiIndex(int substrings = 0);
+
+     /**
+      * @brief Finds the approximate K nearest neighbors.
+      * @param rerank Number of documents with the smallest Hamming distance that are
+      * re-ranked by their exact Euclidean distance; -1 uses 10 * k.
+      */
+     std::vector<Document> searchSimilar(const Document& query, int k, int rerank = -1) const;
+
+     size_t size() const { return docs.size(); }
+     int bits() const { return numBits; }
+     int codeBytes() const { return (numBits + 7) / 8; }
+ };
+
+ #endif // ITQ_INDEX_H
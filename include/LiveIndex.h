@@ -0,0 +1,67 @@
+/**
+ * @file LiveIndex.h
+ * @brief Declares a thread-safe index that absorbs inserts and removals in place.
+ *
+ * Used by the watch mode: files that appear, change or disappear are applied to
+ * the K-d tree and the LSH buckets directly, so small changes never trigger a
+ * full rebuild. Removals leave tombstones in the K-d tree, which is rebuilt only
+ * once tombstones outnumber the live documents (amortized O(log n) per removal).
+ */
+
+ #ifndef LIVE_INDEX_H
+ #define LIVE_INDEX_H
+
+ #include "DataStructures.h"
+ #include <memory>
+ #include <shared_mutex>
+ #include <string>
+ #include <unordered_map>
+ #include <vector>
+
+ /**
+  * @class LiveIndex
+  * @brief Documents keyed by file path, searchable while being updated.
+  *
+  * Searches take a shared lock and updates an exclusive one, so queries keep
+  * running concurrently and only wait for the short in-memory update itself.
+  */
+ class LiveIndex {
+ private:
+     mutable std::shared_mutex mutex;
+     int dims;
+     int nextId;
+     std::unordered_map<std::string, Document> byPath;
+     std::unique_ptr<KdTree> tree;
+     DocumentHash lsh;
+
+     void removeLocked(const Document& d);
+
+ public:
+     /**
+      * @param dimensions Dimensionality of the feature vectors.
+      * @param firstId Id given to the first document inserted; later ones count up.
+      * @param seed Seed of the LSH projections.
+      */
+     LiveIndex(int dimensions, int firstId = 1, unsigned seed = DEFAULT_RANDOM_SEED);
+
+     /**
+      * @brief Adds the document of a file, or replaces it if the path is already indexed
+      * (the document keeps its id).
+      * @return The id of the document.
+      */
+     int insertOrReplace(const std::string& path, const std::vector<float>& features);
+
+     /// Removes the document of a file. @return false if the path is not indexed.
+     bool remove(const std::string& path);
+
+     bool contains(const std::string& path) const;
+     size_t size() const;
+
+     /// Exact K nearest neighbors (K-d tree).
+     std::vector<Document> searchSimilar(const Document& query, int k) const;
+
+     /// Approximate K nearest neighbors among the query's LSH bucket.
+     std::vector<Document> searchApproximate(const Document& query, int k) const;
+ };
+
+ #endif // LIVE_INDEX_H
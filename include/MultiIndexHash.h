@@ -0,0 +1,76 @@
+/**
+ * @file MultiIndexHash.h
+ * @brief Declares multi-index hashing for exact Hamming-space search over binary codes.
+ *
+ * A linear popcount scan touches every code. Multi-index hashing (Norouzi, Punjani
+ * & Fleet) splits each b-bit code into m disjoint substrings and indexes each in its
+ * own hash table. By the pigeonhole principle, two codes within Hamming distance r
+ * agree to within floor(r / m) bits on at least one substring, so probing each
+ * table with the few substrings near the query's finds every r-neighbour exactly.
+ */
+
+ #ifndef MULTI_INDEX_HASH_H
+ #define MULTI_INDEX_HASH_H
+
+ #include "HugePages.h"
+ #include <cstddef>
+ #include <cstdint>
+ #include <unordered_map>
+ #include <vector>
+
+ /**
+  * @class MultiIndexHash
+  * @brief m hash tables over the substrings of codes of up to 64 bits.
+  *
+  * Codes are identified by their insertion order (0, 1, 2, ...).
+  */
+ class MultiIndexHash {
+ private:
+     int numBits;
+     int numTables;
+     std::vector<int> offsets; // First bit of each substring.
+     std::vector<int> widths;  // Bits in each substring (at most 32).
+     // Large bucket arrays come from huge pages; the small nodes stay on the heap.
+     typedef std::unordered_map<uint64_t, std::vector<uint32_t>, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                                HugePageAllocator<std::pair<const uint64_t, std::vector<uint32_t>>>> SubstringTable;
+     std::vector<SubstringTable> tables;
+     HugePageVector<uint64_t> codes; // Full codes, for verifying candidates.
+
+     uint64_t substring(uint64_t code, int table) const;
+     double probeCount(int radius) const;
+     bool firstSeenAt(uint64_t query, uint64_t code, int table, int radius) const;
+     void probe(uint64_t query, int table, int radius, std::vector<uint32_t>& hits) const;
+
+ public:
+     /**
+      * @param bits Code length (1 to 64).
+      * @param substrings Number of tables m; raised as needed so no substring exceeds 32 bits.
+      */
+     MultiIndexHash(int bits, int substrings);
+
+     /// The m of Norouzi et al., about bits / log2(n), for an index of n codes.
+     static int recommendedSubstrings(int bits, size_t n);
+
+     /// Stores a code; its id is the number of codes inserted before it.
+     void insert(uint64_t code);
+
+     /// Ids of all codes within Hamming distance radius of the query (exact, unordered;
+     /// falls back to a linear scan when probing would cost more).
+     std::vector<uint32_t> rangeSearch(uint64_t query, int radius) const;
+
+     /**
+      * @brief Exact Hamming k-NN: ids of the k codes closest to the query, nearest first.
+      *
+      * Tables are probed at substring radius 0, 1, 2, ... in turn; after probing
+      * table a at radius r, every code within r * m + a bits has been seen, so the
+      * search stops as soon as k codes lie within that bound. If a radius would probe
+      * more substrings than there are codes (a poorly chosen m, or a far query), the
+      * search finishes with a linear scan instead.
+      */
+     std::vector<uint32_t> nearest(uint64_t query, int k) const;
+
+     size_t size() const { return codes.size(); }
+     int substrings() const { return numTables; }
+ };
+
+ #endif // MULTI_INDEX_HASH_H
@@ -0,0 +1,53 @@
+/**
+ * @file QuadraticForm.h
+ * @brief Declares the quadratic-form (cross-bin) histogram distance as a feature transform.
+ *
+ * The quadratic-form distance d(x, y) = sqrt((x - y)^T A (x - y)) lets similar
+ * bins (e.g. neighbouring shades of one channel) partially match, but costs
+ * O(D^2) per pair. With the Cholesky factorization A = L L^T it equals the plain
+ * Euclidean distance between L^T x and L^T y, so after transforming every
+ * feature vector once at ingest, all Euclidean indexes answer it unchanged.
+ */
+
+ #ifndef QUADRATIC_FORM_H
+ #define QUADRATIC_FORM_H
+
+ #include <vector>
+
+ /**
+  * @class QuadraticFormTransform
+  * @brief Maps feature vectors into the space where the quadratic form is Euclidean.
+  */
+ class QuadraticFormTransform {
+ private:
+     int dims = 0;
+     std::vector<double> similarity; // A, dims x dims, row-major.
+     std::vector<double> factor;     // L, lower triangular, row-major.
+
+ public:
+     /**
+      * @brief Bin-similarity matrix of the interleaved color histograms.
+      *
+      * Bins i and j of the same channel have similarity exp(-(i - j)^2 / (2 sigma^2));
+      * bins of different channels are unrelated (0). The Gaussian kernel keeps the
+      * matrix positive definite for any sigma > 0.
+      */
+     static std::vector<double> binSimilarity(double sigma = 1.0);
+
+     /**
+      * @brief Factorizes a symmetric similarity matrix (Cholesky).
+      * @param matrix dimensions x dimensions, row-major.
+      * @return false if the matrix is not positive definite.
+      */
+     bool factorize(const std::vector<double>& matrix, int dimensions);
+
+     /// Writes L^T x to out; both hold dims floats.
+     void apply(const float* x, float* out) const;
+
+     /// Reference O(D^2) evaluation of sqrt((x - y)^T A (x - y)), for accuracy checks.
+     double distance(const float* x, const float* y) const;
+
+     int dimensions() const { return dims; }
+ };
+
+ #endif // QUADRATIC_FORM_H
@@ -0,0 +1,107 @@
+/**
+ * @file RandomProjectionForest.h
+ * @brief Declares an Annoy-style forest of random projection trees.
+ *
+ * Each tree recursively splits the documents by the hyperplane halfway between
+ * two randomly sampled points, so the splits follow the data even when the
+ * histogram dimensions are correlated. The whole forest is stored as one flat,
+ * position-independent byte image: build() produces it in memory, save() writes
+ * it verbatim and load() maps the file read-only, so several processes can share
+ * the same physical pages.
+ */
+
+ #ifndef RANDOM_PROJECTION_FOREST_H
+ #define RANDOM_PROJECTION_FOREST_H
+
+ #include "DataStructures.h"
+ #include "HugePages.h"
+ #include <cstdint>
+ #include <vector>
+ #include <string>
+
+ /**
+  * @struct RPNode
+  * @brief A node of a random projection tree, as laid out in the flat image.
+  *
+  * Internal nodes use begin as the index of their hyperplane normal (in units of
+  * one feature vector) and send a point right when dot(normal, x) + offset > 0.
+  * Leaves have left == right == -1 and own the leaf items [begin, begin + count).
+  */
+ struct RPNode {
+     int32_t left;
+     int32_t right;
+     uint32_t begin;
+     uint32_t count;
+     float offset;
+ };
+
+ /**
+  * @class RPForest
+  * @brief Approximate K-NN over a forest of random hyperplane trees.
+  */
+ class RPForest {
+ private:
+     int dims;
+     int numTrees;
+     int leafSize;
+     unsigned seed;
+     std::vector<Document> staged; // Documents waiting for the next build().
+
+     // The flat image, either owned (after build) or memory-mapped (after load).
+     HugePageVector<char> ownedImage;
+     void* mappedImage = nullptr;
+     size_t mappedSize = 0;
+
+     // Views into the image.
+     uint32_t numDocs = 0;
+     const int32_t* roots = nullptr;
+     const RPNode* nodes = nullptr;
+     const float* normals = nullptr;
+     const int32_t* leafItems = nullptr;
+     const float* features = nullptr;
+     const int32_t* ids = nullptr;
+     const uint32_t* nameOffsets = nullptr;
+     const char* names = nullptr;
+
+     bool attach(const char* image, size_t size);
+     void unmap();
+
+ public:
+     /**
+      * @param dimensions Dimensionality of the feature vectors.
+      * @param nTrees Number of trees in the forest; more trees raise recall.
+      * @param maxLeafSize Maximum number of documents stored in a leaf.
+      * @param seed Seed of the split sampling; tree t uses seed + t.
+      */
+     RPForest(int dimensions, int nTrees, int maxLeafSize = 16, unsigned seed = DEFAULT_RANDOM_SEED);
+     ~RPForest();
+     RPForest(const RPForest&) = delete;
+     RPForest& operator=(const RPForest&) = delete;
+
+     /// Stages a document; it becomes searchable after the next build().
+     void insert(const Document& d);
+
+     /**
+      * @brief Builds all trees from the staged documents, one tree per task.
+      * @param numThreads Worker threads to use; 0 uses all hardware threads.
+      * @return false if the forest does not fit its image format; it is then empty.
+      */
+     bool build(int numThreads = 0);
+
+     /**
+      * @brief Finds the approximate K nearest neighbors of a query.
+      * @param searchK Number of candidate documents to collect from the trees
+      * before exact re-ranking; -1 uses k * numTrees. Larger is slower but more accurate.
+      */
+     std::vector<Document> searchSimilar(const Document& query, int k, int searchK = -1) const;
+
+     size_t size() const { return numDocs; }
+
+     /// Writes the flat image to a file. @return false if the file could not be written.
+     bool save(const std::string& path) const;
+
+     /// Maps a file written by save() read-only. @return false if it is missing or malformed.
+     bool load(const std::string& path);
+ };
+
+ #endif // RANDOM_PROJECTION_FOREST_H
@@ -0,0 +1,76 @@
+/**
+ * @file StreamingDecoder.h
+ * @brief Declares a bounded-memory extraction path for very large JPEG and PNG files.
+ *
+ * cv::imread() materializes the whole bitmap before a histogram can be counted,
+ * so a single gigapixel scan costs gigabytes of memory. The StreamingExtractor
+ * instead decodes a few scanlines at a time with libjpeg / libpng and feeds each
+ * band to the incremental accumulators of ImageUtils.h, so its memory use only
+ * depends on the image width.
+ *
+ * The accumulators see rows in file order, so a JPEG whose EXIF orientation tag
+ * asks for a rotation or mirror is not streamed: it is reported Unsupported and
+ * decoded in memory, where cv::imdecode applies the tag. Its dHash, integral
+ * histogram and thumbnail then match those of the same photo below the budget,
+ * at the cost of holding its whole bitmap.
+ */
+
+ #ifndef STREAMING_DECODER_H
+ #define STREAMING_DECODER_H
+
+ #include "ImageUtils.h"
+ #include "ThumbnailStore.h"
+ #include <cstdio>
+
+ /// Outcome of a streaming extraction.
+ enum class StreamStatus {
+     Extracted,   ///< The histogram (and the optional outputs) were computed.
+     Unsupported, ///< The file cannot be streamed (format, color space, interlacing, EXIF rotation, or no decoder library).
+     Failed       ///< The file could not be opened or is corrupt.
+ };
+
+ /**
+  * @class StreamingExtractor
+  * @brief Computes the same features as HistogramExtractor while decoding band by band.
+  *
+  * Like HistogramExtractor it is meant to be owned by a single worker thread and
+  * reuses its band buffer between files.
+  */
+ class StreamingExtractor {
+ private:
+     static constexpr int BAND_ROWS = 16;
+
+     cv::Mat band;                                 ///< BAND_ROWS decoded rows in 8-bit BGR.
+     unsigned counts[3][HISTOGRAM_BINS];           ///< Raw bin counts of the current image.
+     DHashBuilder dhash;
+     uint64_t* hashOut = nullptr;
+     IntegralHistogram* integralOut = nullptr;
+     ThumbnailBuilder* thumbnailOut = nullptr;
+     int thumbnailSideOut = 0;
+
+     void beginImage(int rows, int cols);
+     void addBand(int firstRow, int rows);
+     StreamStatus decodeJpeg(FILE* file);
+     StreamStatus decodePng(FILE* file);
+
+ public:
+     /**
+      * @brief Decodes a JPEG or PNG file incrementally and computes its histogram.
+      * @param out Destination for HISTOGRAM_SIZE floats, e.g. a row of a feature matrix.
+      * @param perceptualHash If not null, also receives the dHash of the image.
+      * @param integral If not null, is rebuilt from the image for later region queries.
+      * @param thumbnail If not null, receives the image at thumbnailSide x thumbnailSide.
+      * @return Unsupported when the caller should fall back to the in-memory path.
+      */
+     StreamStatus extractFile(const std::string& path, float* out, uint64_t* perceptualHash = nullptr,
+                              IntegralHistogram* integral = nullptr, ThumbnailBuilder* thumbnail = nullptr,
+                              int thumbnailSide = ThumbnailStore::DEFAULT_SIDE);
+
+     /**
+      * @brief Reads the dimensions of a JPEG or PNG file from its header, without decoding pixels.
+      * @return false if the file is neither, is corrupt, or no decoder library is available.
+      */
+     static bool readImageSize(const std::string& path, int& rows, int& cols);
+ };
+
+ #endif // STREAMING_DECODER_H
@@ -0,0 +1,131 @@
+/**
+ * @file ThumbnailStore.h
+ * @brief Declares a memory-mapped store of small raw thumbnails.
+ *
+ * Changing a feature definition (bins, color space, ...) normally means decoding
+ * every original image again. During the first ingest, each image can also be
+ * box-averaged into a fixed-size BGR thumbnail and written to one contiguous,
+ * mmap-able file; later runs recompute any feature from those raw pixels at
+ * memory-bandwidth speed, without touching the image decoders.
+ */
+
+ #ifndef THUMBNAIL_STORE_H
+ #define THUMBNAIL_STORE_H
+
+ #include <opencv2/opencv.hpp>
+ #include <cstdint>
+ #include <string>
+ #include <vector>
+
+ /**
+  * @class ThumbnailBuilder
+  * @brief Box-averages an image, delivered whole or in bands of rows, into a square thumbnail.
+  *
+  * The aspect ratio is not kept: the features derived from thumbnails (histograms,
+  * dHash, grid-based integral histograms) only depend on relative positions.
+  */
+ class ThumbnailBuilder {
+ private:
+     int side = 0;
+     int imageRows = 0, imageCols = 0;
+     std::vector<uint64_t> sums; ///< Per thumbnail pixel and channel, the sum of its source block.
+
+ public:
+     void begin(int rows, int cols, int thumbnailSide); ///< Starts an image of the given size.
+     void addRows(const cv::Mat& band, int firstRow);   ///< Adds the rows [firstRow, firstRow + band.rows).
+     void finish(unsigned char* out) const;             ///< Writes side * side BGR pixels.
+
+     int rows() const { return imageRows; }
+     int cols() const { return imageCols; }
+ };
+
+ /**
+  * @struct SourceStamp
+  * @brief Size and modification time of the file a thumbnail slot was made from.
+  */
+ struct SourceStamp {
+     uint64_t size = 0;
+     int64_t mtimeNs = 0;
+ };
+
+ /**
+  * @class ThumbnailStore
+  * @brief One file holding a fixed-size thumbnail slot for each image of a dataset.
+  *
+  * create() maps a new file writable so ingestion workers can fill distinct slots
+  * concurrently; open() maps an existing file read-only, or writable to refresh
+  * stale slots. A store only counts as usable once markComplete() has run after
+  * all slots were attempted, and a slot only while its source file keeps the
+  * size and modification time recorded by setSource().
+  */
+ class ThumbnailStore {
+ private:
+     void* mappedImage = nullptr;
+     size_t mappedSize = 0;
+     bool writable = false;
+
+     // Views into the mapping.
+     uint64_t count = 0;
+     int side = 0;
+     uint32_t* originalSizes = nullptr; // rows, cols per slot; 0, 0 while a slot is empty.
+     SourceStamp* stamps = nullptr;      // Per slot; zero until setSource().
+     const uint32_t* nameOffsets = nullptr;
+     const char* names = nullptr;
+     unsigned char* pixels = nullptr;
+
+     bool attach(size_t size);
+     size_t slotBytes() const { return (size_t)side * side * 3; }
+
+ public:
+     static constexpr int DEFAULT_SIDE = 64;
+
+     ThumbnailStore() = default;
+     ~ThumbnailStore();
+     ThumbnailStore(const ThumbnailStore&) = delete;
+     ThumbnailStore& operator=(const ThumbnailStore&) = delete;
+
+     /**
+      * @brief Creates (or truncates) a store with one empty slot per image name.
+      * @return false if the file could not be created or mapped.
+      */
+     bool create(const std::string& path, const std::vector<std::string>& imageNames, int thumbnailSide = DEFAULT_SIDE);
+
+     /**
+      * @brief Maps a completed store. With forUpdate, the store is writable and counts
+      * as incomplete again until markComplete().
+      * @return false if it is missing, malformed or was never completed.
+      */
+     bool open(const std::string& path, bool forUpdate = false);
+
+     /// Flushes every slot, then sets the completion flag. Call once all workers are done.
+     bool markComplete();
+
+     /// Unmaps the store; pending writes reach the file through the page cache.
+     void close();
+
+     /// Finishes a builder straight into slot index. Safe to call concurrently for distinct slots.
+     void put(size_t index, const ThumbnailBuilder& builder);
+
+     /// Copies the thumbnail of slot from into slot to (e.g. for byte-identical files).
+     void copy(size_t from, size_t to);
+
+     /// Records the size and modification time of the file slot index was made from; call after put() or copy().
+     void setSource(size_t index, const std::string& path);
+
+     /// Whether slot index holds a thumbnail of the file at path as it is now.
+     bool isCurrent(size_t index, const std::string& path) const;
+
+     bool isOpen() const { return mappedImage != nullptr; }
+     bool isWritable() const { return writable; }
+     size_t size() const { return count; }
+     int thumbnailSide() const { return side; }
+     std::string name(size_t index) const;
+     bool has(size_t index) const { return originalSizes[index * 2] != 0; }
+     int originalRows(size_t index) const { return (int)originalSizes[index * 2]; }
+     int originalCols(size_t index) const { return (int)originalSizes[index * 2 + 1]; }
+
+     /// The pixels of a slot as a BGR image header over the mapping (no copy).
+     cv::Mat thumbnail(size_t index) const;
+ };
+
+ #endif // THUMBNAIL_STORE_H
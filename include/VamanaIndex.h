@@ -0,0 +1,101 @@
+/**
+ * @file VamanaIndex.h
+ * @brief Declares a DiskANN-style Vamana graph index with SSD-resident vectors.
+ *
+ * Only the product-quantized (PQ) codes of the documents stay in memory; they
+ * are used to steer the graph search. The full-precision vectors and the
+ * adjacency lists are stored together on disk in 4 KB sector-aligned blocks,
+ * so expanding a node costs exactly one sector read, issued asynchronously for
+ * a whole beam of nodes at a time.
+ */
+
+ #ifndef VAMANA_INDEX_H
+ #define VAMANA_INDEX_H
+
+ #include "DataStructures.h"
+ #include <cstdint>
+ #include <vector>
+ #include <string>
+
+ /**
+  * @class VamanaIndex
+  * @brief Single-layer Vamana graph searched with a PQ-guided beam search.
+  *
+  * Usage: insert() the documents, build() the on-disk index once (which also
+  * opens it), then call searchSimilar(). An index built earlier can be reopened
+  * with open().
+  */
+ class VamanaIndex {
+ private:
+     int dims;
+     int maxDegree;   // R: maximum out-degree of a node.
+     int listSize;    // L: candidate list size used while building.
+     float alpha;     // Pruning slack; > 1 keeps long-range edges.
+     int numSubspaces; // M: number of PQ sub-quantizers (one byte each).
+     unsigned seed;    // Seeds the graph initialization and, plus one, the PQ k-means.
+
+     std::vector<Document> staged; // Documents waiting for build().
+
+     // In-memory navigation data loaded by open().
+     uint32_t numDocs = 0;
+     uint32_t medoid = 0;
+     uint32_t numCentroids = 0;
+     std::vector<int> subspaceBegin;  // Dimension ranges of each subspace (M + 1 entries).
+     std::vector<float> codebooks;    // For each subspace, numCentroids centroids.
+     std::vector<uint8_t> codes;      // numDocs * M centroid indices.
+
+     // On-disk node layout. Node sectors are read through fd (O_DIRECT when the
+     // file system supports it); the filenames through the buffered metaFd.
+     int fd = -1;
+     int metaFd = -1;
+     uint32_t blockSize = 0;
+     uint32_t nodesPerSector = 0;
+     uint32_t sectorsPerNode = 0;
+     uint64_t namesOffset = 0;
+     uint64_t fileSize = 0;
+
+     void close();
+     uint64_t nodeSectorOffset(uint32_t node) const;
+     std::vector<std::vector<uint32_t>> buildGraph(uint32_t start) const;
+     void trainQuantizer(std::vector<float>& outCodebooks, std::vector<uint8_t>& outCodes, uint32_t& outCentroids) const;
+     bool writeIndex(const std::string& path, const std::vector<std::vector<uint32_t>>& graph, uint32_t start,
+                     const std::vector<float>& cb, const std::vector<uint8_t>& pqCodes, uint32_t centroids) const;
+
+ public:
+     /**
+      * @param dimensions Dimensionality of the feature vectors.
+      * @param R Maximum out-degree of a graph node.
+      * @param L Candidate list size used during construction.
+      * @param a Pruning parameter alpha (DiskANN uses 1.2).
+      * @param M Number of PQ subspaces; each document is compressed to M bytes.
+      * @param randomSeed Seed of the random initial graph, insertion order and k-means.
+      */
+     VamanaIndex(int dimensions, int R = 32, int L = 64, float a = 1.2f, int M = 8, unsigned randomSeed = DEFAULT_RANDOM_SEED);
+     ~VamanaIndex();
+     VamanaIndex(const VamanaIndex&) = delete;
+     VamanaIndex& operator=(const VamanaIndex&) = delete;
+
+     /// Stages a document for the next build().
+     void insert(const Document& d);
+
+     /**
+      * @brief Builds the graph and PQ codes from the staged documents, writes
+      * the index file and opens it. The staged documents are released.
+      * @return false if there is nothing to build or the file cannot be written.
+      */
+     bool build(const std::string& path);
+
+     /// Opens an index file written by build(). @return false if it is missing or malformed.
+     bool open(const std::string& path);
+
+     /**
+      * @brief Finds the approximate K nearest neighbors with a beam search.
+      * @param beamWidth Number of node reads issued concurrently per step (W).
+      * @param searchL Candidate list size; -1 uses max(k, L).
+      */
+     std::vector<Document> searchSimilar(const Document& query, int k, int beamWidth = 4, int searchL = -1) const;
+
+     size_t size() const { return numDocs; }
+ };
+
+ #endif // VAMANA_INDEX_H
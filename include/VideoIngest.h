@@ -0,0 +1,65 @@
+/**
+ * @file VideoIngest.h
+ * @brief Declares the ingestion of local video files as keyframe documents.
+ *
+ * A video is decoded with OpenCV and sampled every N frames; a sampled frame is
+ * only kept as a keyframe when its histogram differs enough from the previous
+ * keyframe (a scene change), so static shots do not flood the index with
+ * near-identical documents. Keyframes become ordinary documents whose filename
+ * carries the source and time as a media fragment, e.g. "data/clip.mp4#t=12.480".
+ */
+
+ #ifndef VIDEO_INGEST_H
+ #define VIDEO_INGEST_H
+
+ #include "ImageUtils.h"
+ #include <string>
+ #include <vector>
+
+ /**
+  * @struct VideoKeyframe
+  * @brief The features of one kept frame, as HistogramExtractor::extract() computes them.
+  */
+ struct VideoKeyframe {
+     int frameIndex = 0;
+     double timestamp = 0.0;         ///< Seconds from the start of the video.
+     std::vector<float> features;    ///< HISTOGRAM_SIZE floats.
+     uint64_t perceptualHash = 0;    ///< computeDHash() of the frame.
+     IntegralHistogram integral;     ///< For region queries, like the image documents.
+ };
+
+ /**
+  * @class VideoIngestor
+  * @brief Samples and deduplicates the frames of video files; reuses its frame buffer.
+  */
+ class VideoIngestor {
+ private:
+     int frameStep;
+     float sceneThreshold;
+     cv::VideoCapture capture;
+     cv::Mat frame;
+
+ public:
+     /**
+      * @param step Decode every step-th frame; the others are only demuxed (grab()).
+      * @param threshold Minimum Euclidean distance between the histogram of a sampled
+      * frame and the last keyframe for the frame to become a new keyframe.
+      */
+     VideoIngestor(int step = 10, float threshold = 0.25f);
+
+     /**
+      * @brief Decodes a video and appends its keyframes.
+      * @param keyframes Receives the keyframes in presentation order.
+      * @param sampledFrames If not null, receives the number of frames compared.
+      * @return false if the file could not be opened as a video.
+      */
+     bool ingest(const std::string& path, std::vector<VideoKeyframe>& keyframes, int* sampledFrames = nullptr);
+ };
+
+ /// Whether a path has a video file extension (.mp4, .avi, .mkv, .mov, .webm).
+ bool isVideoFile(const std::string& path);
+
+ /// The document filename of a keyframe: "<path>#t=<seconds>" with millisecond precision.
+ std::string videoFrameName(const std::string& path, double timestamp);
+
+ #endif // VIDEO_INGEST_H
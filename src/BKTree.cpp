@@ -0,0 +1,57 @@
+/**
+ * @file BKTree.cpp
+ * @brief Implements the BK-tree used for perceptual-hash near-duplicate search.
+ */
+
+ #include "BKTree.h"
+ #include <algorithm> // for std::stable_sort
+ #include <cstdlib>   // for std::abs
+
+ void BKTree::insert(uint64_t hash, const Document& d) {
+     if (nodes.empty()) {
+         nodes.emplace_back(hash, d);
+         return;
+     }
+
+     int node = 0;
+     while (true) {
+         int dist = hammingDistance(hash, nodes[node].hash);
+         int next = -1;
+         for (const auto& child : nodes[node].children) {
+             if (child.first == dist) { next = child.second; break; }
+         }
+         if (next == -1) {
+             // Note: emplace_back may reallocate, so only indices are kept across it.
+             nodes.emplace_back(hash, d);
+             nodes[node].children.push_back({dist, (int)nodes.size() - 1});
+             return;
+         }
+         node = next;
+     }
+ }
+
+ std::vector<Document> BKTree::searchWithin(uint64_t hash, int maxDistance) const {
+     if (nodes.empty()) return {};
+
+     std::vector<std::pair<int, int>> matches; // (distance, node)
+     std::vector<int> stack = {0};
+     while (!stack.empty()) {
+         int node = stack.back();
+         stack.pop_back();
+         int dist = hammingDistance(hash, nodes[node].hash);
+         if (dist <= maxDistance) matches.push_back({dist, node});
+
+         // Triangle inequality: only subtrees whose edge label lies within
+         // [dist - maxDistance, dist + maxDistance] can contain matches.
+         for (const auto& child : nodes[node].children) {
+             if (std::abs(child.first - dist) <= maxDistance) stack.push_back(child.second);
+         }
+     }
+
+     std::stable_sort(matches.begin(), matches.end(), [](const std::pair<int, int>& a, const std::pair<int, int>& b) {
+         return a.first < b.first;
+     });
+     std::vector<Document> results;
+     for (const auto& m : matches) results.push_back(nodes[m.second].doc);
+     return results;
+ }
@@ -0,0 +1,241 @@
+/**
+ * @file CompactKdTree.cpp
+ * @brief Implements the bulk build and the search of the compact kd-tree.
+ */
+
+ #include "CompactKdTree.h"
+ #include <algorithm> // for std::nth_element, std::partition, std::sort
+ #include <cmath>
+
+ //=============================================================================
+ // Build
+ //=============================================================================
+
+ void CompactKdTree::build(const std::vector<Document>& input, NodeLayout layout) {
+     nodes.clear();
+     features.clear();
+     docs.clear();
+     gridLower.clear();
+     gridStep.clear();
+     dims = input.empty() ? 0 : (int)input[0].features.size();
+     if (input.empty()) return;
+
+     // The quantization grid spans the corpus: 65,536 split values per dimension.
+     gridLower.assign(dims, 0.0f);
+     gridStep.assign(dims, 0.0f);
+     for (int j = 0; j < dims; j++) {
+         float lo = input[0].features[j], hi = lo;
+         for (const auto& d : input) {
+             lo = std::min(lo, d.features[j]);
+             hi = std::max(hi, d.features[j]);
+         }
+         gridLower[j] = lo;
+         gridStep[j] = (hi - lo) / UINT16_MAX;
+     }
+
+     std::vector<uint32_t> order(input.size());
+     for (size_t i = 0; i < order.size(); ++i) order[i] = (uint32_t)i;
+     nodes.push_back({});
+     buildNode(0, order, 0, (uint32_t)order.size(), input);
+
+     features.resize(input.size() * dims);
+     docs.reserve(input.size());
+     for (size_t i = 0; i < order.size(); ++i) {
+         const Document& d = input[order[i]];
+         std::copy(d.features.begin(), d.features.end(), &features[i * dims]);
+         docs.push_back(d);
+     }
+     setLayout(layout);
+ }
+
+ void CompactKdTree::buildNode(uint32_t slot, std::vector<uint32_t>& order, uint32_t begin, uint32_t end, const std::vector<Document>& input) {
+     uint32_t count = end - begin;
+     if (count > (uint32_t)std::max(leafSize, 1)) {
+         // Try the dimensions from the widest spread down; one fails only when its
+         // points all fall within a single quantum of the grid.
+         std::vector<std::pair<float, int>> spread;
+         for (int j = 0; j < dims; j++) {
+             float lo = input[order[begin]].features[j], hi = lo;
+             for (uint32_t i = begin; i < end; i++) {
+                 lo = std::min(lo, input[order[i]].features[j]);
+                 hi = std::max(hi, input[order[i]].features[j]);
+             }
+             if (hi > lo) spread.push_back({hi - lo, j});
+         }
+         std::sort(spread.rbegin(), spread.rend());
+
+         for (const auto& candidate : spread) {
+             int axis = candidate.second;
+             auto coordinate = [&](uint32_t i) { return input[i].features[axis]; };
+             uint32_t mid = begin + count / 2;
+             std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                              [&](uint32_t a, uint32_t b) { return coordinate(a) < coordinate(b); });
+
+             float quantum = std::round((coordinate(order[mid]) - gridLower[axis]) / gridStep[axis]);
+             CompactKdNode node = {0, (uint16_t)std::min(std::max(quantum, 0.0f), (float)UINT16_MAX), (uint8_t)axis, 0};
+             float split = splitValue(node);
+
+             // Partition by the quantized plane itself; x <= split is as exact a bound as x < split.
+             auto cut = std::partition(order.begin() + begin, order.begin() + end, [&](uint32_t i) { return coordinate(i) < split; });
+             if (cut == order.begin() + begin || cut == order.begin() + end) {
+                 cut = std::partition(order.begin() + begin, order.begin() + end, [&](uint32_t i) { return coordinate(i) <= split; });
+             }
+             if (cut == order.begin() + begin || cut == order.begin() + end) continue;
+
+             // Siblings are allocated as a pair, so the node stores only the left child's index.
+             node.child = (uint32_t)nodes.size();
+             nodes.resize(nodes.size() + 2);
+             nodes[slot] = node;
+             uint32_t middle = (uint32_t)(cut - order.begin());
+             buildNode(node.child, order, begin, middle, input);
+             buildNode(node.child + 1, order, middle, end, input);
+             return;
+         }
+     }
+     nodes[slot] = {begin, (uint16_t)(count & 0xFFFF), COMPACT_KD_LEAF, (uint8_t)(count >> 16)};
+ }
+
+ //=============================================================================
+ // Node Layouts
+ //=============================================================================
+
+ namespace {
+
+ // The layouts order sibling pairs, named by the index of their left node, so
+ // that a node's children stay adjacent. The root has no sibling and stays at 0.
+ struct PairOrder {
+     const HugePageVector<CompactKdNode>& nodes;
+     std::vector<int> heights; // By pair: the number of pair levels in its subtree.
+     std::vector<uint32_t> order;
+
+     // The child pairs of a pair: those of its left member, then of its right member.
+     int children(uint32_t pair, uint32_t out[2]) const {
+         int count = 0;
+         for (uint32_t member = pair; member < pair + 2; member++) {
+             if (nodes[member].axis != COMPACT_KD_LEAF) out[count++] = nodes[member].child;
+         }
+         return count;
+     }
+
+     int height(uint32_t pair) {
+         if (heights[pair] == 0) {
+             uint32_t child[2];
+             int count = children(pair, child);
+             int tallest = 0;
+             for (int c = 0; c < count; c++) tallest = std::max(tallest, height(child[c]));
+             heights[pair] = tallest + 1;
+         }
+         return heights[pair];
+     }
+
+     void depthFirst(uint32_t pair) {
+         order.push_back(pair);
+         uint32_t child[2];
+         int count = children(pair, child);
+         for (int c = 0; c < count; c++) depthFirst(child[c]);
+     }
+
+     void breadthFirst(uint32_t rootPair) {
+         order.push_back(rootPair);
+         for (size_t i = 0; i < order.size(); i++) {
+             uint32_t child[2];
+             int count = children(order[i], child);
+             for (int c = 0; c < count; c++) order.push_back(child[c]);
+         }
+     }
+
+     // Emits the pairs less than levels below pair: the top half of those levels
+     // as one recursive block, then each subtree hanging below it as another.
+     void vanEmdeBoas(uint32_t pair, int levels) {
+         if (levels == 1) {
+             order.push_back(pair);
+             return;
+         }
+         int top = levels / 2;
+         vanEmdeBoas(pair, top);
+         std::vector<uint32_t> bottoms;
+         collect(pair, top, bottoms);
+         for (uint32_t bottom : bottoms) vanEmdeBoas(bottom, levels - top);
+     }
+
+     // The pairs exactly depth levels below pair, left to right.
+     void collect(uint32_t pair, int depth, std::vector<uint32_t>& out) const {
+         if (depth == 0) {
+             out.push_back(pair);
+             return;
+         }
+         uint32_t child[2];
+         int count = children(pair, child);
+         for (int c = 0; c < count; c++) collect(child[c], depth - 1, out);
+     }
+ };
+
+ } // namespace
+
+ void CompactKdTree::setLayout(NodeLayout layout) {
+     if (nodes.empty() || nodes[0].axis == COMPACT_KD_LEAF) return;
+
+     PairOrder pairs = {nodes, std::vector<int>(nodes.size(), 0), {}};
+     pairs.order.reserve(nodes.size() / 2);
+     uint32_t rootPair = nodes[0].child;
+     if (layout == NodeLayout::DepthFirst) pairs.depthFirst(rootPair);
+     else if (layout == NodeLayout::BreadthFirst) pairs.breadthFirst(rootPair);
+     else pairs.vanEmdeBoas(rootPair, pairs.height(rootPair));
+
+     std::vector<uint32_t> position(nodes.size(), 0);
+     for (size_t i = 0; i < pairs.order.size(); i++) {
+         position[pairs.order[i]] = (uint32_t)(1 + 2 * i);
+         position[pairs.order[i] + 1] = (uint32_t)(2 + 2 * i);
+     }
+     HugePageVector<CompactKdNode> moved(nodes.size());
+     for (size_t i = 0; i < nodes.size(); i++) {
+         CompactKdNode node = nodes[i];
+         if (node.axis != COMPACT_KD_LEAF) node.child = position[node.child];
+         moved[position[i]] = node;
+     }
+     nodes.swap(moved);
+ }
+
+ //=============================================================================
+ // K-Nearest Neighbor Search
+ //=============================================================================
+
+ std::vector<Document> CompactKdTree::searchSimilar(const Document& query, int k) const {
+     if (nodes.empty() || k <= 0) return {};
+
+     std::priority_queue<std::pair<float, uint32_t>> best_docs;
+     searchSimilarRec(0, query.features.data(), k, best_docs);
+
+     std::vector<Document> results;
+     for (; !best_docs.empty(); best_docs.pop()) results.push_back(docs[best_docs.top().second]);
+     std::reverse(results.begin(), results.end()); // Nearest first
+     return results;
+ }
+
+ void CompactKdTree::searchSimilarRec(uint32_t node, const float* query, size_t k, std::priority_queue<std::pair<float, uint32_t>>& best_docs) const {
+     const CompactKdNode& n = nodes[node];
+
+     if (n.axis == COMPACT_KD_LEAF) {
+         // The leaf's documents are one contiguous run of features.
+         uint32_t end = n.child + ((uint32_t)n.countHigh << 16 | n.split);
+         for (uint32_t pos = n.child; pos < end; pos++) {
+             const float* x = &features[(size_t)pos * dims];
+             float dist = metric == Metric::Manhattan ? manhattanDistance(query, x, dims) : euclideanDistance(query, x, dims);
+             if (best_docs.size() < k) {
+                 best_docs.push({dist, pos});
+             } else if (dist < best_docs.top().first) {
+                 best_docs.pop();
+                 best_docs.push({dist, pos});
+             }
+         }
+         return;
+     }
+
+     float diff = query[n.axis] - splitValue(n);
+     uint32_t nearChild = diff < 0 ? n.child : n.child + 1;
+     uint32_t farChild = diff < 0 ? n.child + 1 : n.child;
+     searchSimilarRec(nearChild, query, k, best_docs);
+     if (best_docs.size() < k || std::abs(diff) < best_docs.top().first) {
+         searchSimilarRec(farChild, query, k, best_docs);
+     }
+ }
@@ -0,0 +1,414 @@
+/**
+ * @file CoverTree.cpp
+ * @brief Implements the simplified cover tree index and its flat binary format.
+ */
+
+ #include "CoverTree.h"
+ #include <algorithm> // for std::sort, std::reverse
+ #include <cstdint>
+ #include <cstring>
+ #include <fstream>
+
+ namespace {
+
+ const char COVER_TREE_MAGIC[4] = {'C', 'V', 'T', 'R'};
+ const uint32_t COVER_TREE_VERSION = 1;
+
+ // Fixed-size on-disk record of a node. Children are stored as the range
+ // [childBegin, childBegin + childCount) of a single shared index array.
+ struct CoverNodeRecord {
+     int32_t doc;
+     int32_t level;
+     float maxDist;
+     uint32_t childBegin;
+     uint32_t childCount;
+ };
+
+ template <typename T>
+ void writePod(std::ofstream& out, const T& value) {
+     out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+ }
+
+ template <typename T>
+ bool readPod(std::ifstream& in, T& value) {
+     return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+ }
+
+ } // namespace
+
+ //=============================================================================
+ // Insertion
+ //=============================================================================
+
+ float CoverTree::coverDist(int level) {
+     return std::ldexp(1.0f, level);
+ }
+
+ void CoverTree::insert(const Document& d) {
+     int docIndex = (int)docs.size();
+     docs.push_back(d);
+
+     if (root == -1) {
+         nodes.emplace_back(docIndex, 0);
+         root = 0;
+         return;
+     }
+
+     float dist = euclideanDistance(docs[nodes[root].doc].features, d.features);
+
+     // Raise the root level until it covers the new point. Its current children
+     // stay within the (larger) covering radius, so the tree remains valid.
+     while (coverDist(nodes[root].level) < dist) {
+         nodes[root].level++;
+     }
+     insertRec(root, docIndex, dist);
+ }
+
+ void CoverTree::insertRec(int node, int docIndex, float dist) {
+     nodes[node].maxDist = std::max(nodes[node].maxDist, dist);
+
+     // Exact duplicates are attached directly so they do not form a long chain.
+     if (dist > 0.0f) {
+         int bestChild = -1;
+         float bestDist = FLT_MAX;
+         for (int child : nodes[node].children) {
+             float d = euclideanDistance(docs[nodes[child].doc].features, docs[docIndex].features);
+             if (d <= coverDist(nodes[child].level) && d < bestDist) {
+                 bestChild = child;
+                 bestDist = d;
+             }
+         }
+         if (bestChild != -1) {
+             insertRec(bestChild, docIndex, bestDist);
+             return;
+         }
+     }
+
+     // No child covers the point: it becomes a new child one level below.
+     // Note: emplace_back may reallocate, so only indices are kept across it.
+     int level = nodes[node].level - 1;
+     nodes.emplace_back(docIndex, level);
+     nodes[node].children.push_back((int)nodes.size() - 1);
+ }
+
+ //=============================================================================
+ // K-Nearest Neighbor Search
+ //=============================================================================
+
+ std::vector<Document> CoverTree::searchSimilar(const Document& query, int k) const {
+     if (root == -1 || k <= 0) return {};
+
+     std::priority_queue<DocDist> best_docs;
+     float rootDist = euclideanDistance(query.features, docs[nodes[root].doc].features);
+     searchSimilarRec(root, rootDist, query, k, best_docs);
+
+     std::vector<Document> results;
+     while (!best_docs.empty()) {
+         results.push_back(best_docs.top().doc);
+         best_docs.pop();
+     }
+     std::reverse(results.begin(), results.end()); // Nearest first
+     return results;
+ }
+
+ void CoverTree::searchSimilarRec(int node, float nodeDist, const Document& query, int k, std::priority_queue<DocDist>& best_docs) const {
+     const CoverNode& n = nodes[node];
+
+     if (best_docs.size() < (size_t)k) {
+         best_docs.push({docs[n.doc], nodeDist});
+     } else if (nodeDist < best_docs.top().dist) {
+         best_docs.pop();
+         best_docs.push({docs[n.doc], nodeDist});
+     }
+
+     // Visit the closest children first so the K-th best distance shrinks quickly.
+     std::vector<std::pair<float, int>> ordered;
+     ordered.reserve(n.children.size());
+     for (int child : n.children) {
+         float d = euclideanDistance(query.features, docs[nodes[child].doc].features);
+         ordered.push_back({d, child});
+     }
+     std::sort(ordered.begin(), ordered.end());
+
+     for (const auto& entry : ordered) {
+         // Triangle inequality: no descendant of the child is closer than this.
+         float lowerBound = entry.first - nodes[entry.second].maxDist;
+         if (best_docs.size() < (size_t)k || lowerBound < best_docs.top().dist) {
+             searchSimilarRec(entry.second, entry.first, query, k, best_docs);
+         }
+     }
+ }
+
+ // searchSimilarRec unrolled onto an explicit stack. The children are pushed in
+ // reverse order of distance with their lower bounds, which are tested when a
+ // child is popped, after its nearer siblings' subtrees, as in the recursion.
+ struct CoverTree::BatchSearch {
+     struct Frame {
+         int node;
+         float dist;
+         float lowerBound;
+     };
+     struct Candidate {
+         int doc;
+         float dist;
+         bool operator<(const Candidate& other) const { return dist < other.dist; }
+     };
+
+     const CoverTree* tree;
+     const Document* query;
+     size_t k;
+     std::vector<Frame> stack;
+     std::priority_queue<Candidate> best_docs;
+     const CoverNode* current = nullptr;
+     // 0: pick the next node; 1-4: the node, its child indices, the child nodes and
+     // the child features have arrived, in that order.
+     int stage = 0;
+
+     BatchSearch(const CoverTree* t, const Document* q, int kNearest) : tree(t), query(q), k(kNearest) {
+         float rootDist = euclideanDistance(q->features, t->docs[t->nodes[t->root].doc].features);
+         stack.push_back({t->root, rootDist, -FLT_MAX});
+     }
+
+     bool step() {
+         const auto& nodes = tree->nodes;
+         const auto& docs = tree->docs;
+         switch (stage) {
+             case 1:
+                 if (!current->children.empty()) {
+                     prefetchRange(current->children.data(), current->children.size() * sizeof(int));
+                     stage = 2;
+                     return true;
+                 }
+                 break;
+             case 2:
+                 for (int child : current->children) prefetchObject(&nodes[child]);
+                 stage = 3;
+                 return true;
+             case 3:
+                 for (int child : current->children) prefetchObject(&docs[nodes[child].doc]);
+                 stage = 4;
+                 return true;
+             case 4:
+                 for (int child : current->children) {
+                     const std::vector<float>& features = docs[nodes[child].doc].features;
+                     prefetchRange(features.data(), features.size() * sizeof(float));
+                 }
+                 stage = 5;
+                 return true;
+             case 5:
+                 expand();
+                 break;
+         }
+
+         while (!stack.empty()) {
+             Frame frame = stack.back();
+             stack.pop_back();
+             if (best_docs.size() >= k && !(frame.lowerBound < best_docs.top().dist)) continue;
+             // The node was loaded to compute its distance, so it is visited right away.
+             current = &nodes[frame.node];
+             if (best_docs.size() < k) {
+                 best_docs.push({current->doc, frame.dist});
+             } else if (frame.dist < best_docs.top().dist) {
+                 best_docs.pop();
+                 best_docs.push({current->doc, frame.dist});
+             }
+             prefetchObject(current);
+             stage = 1;
+             return true;
+         }
+         stage = 0;
+         return false;
+     }
+
+     void expand() {
+         std::vector<std::pair<float, int>> ordered;
+         ordered.reserve(current->children.size());
+         for (int child : current->children) {
+             float d = euclideanDistance(query->features, tree->docs[tree->nodes[child].doc].features);
+             ordered.push_back({d, child});
+         }
+         std::sort(ordered.begin(), ordered.end());
+         for (auto it = ordered.rbegin(); it != ordered.rend(); ++it) {
+             stack.push_back({it->second, it->first, it->first - tree->nodes[it->second].maxDist});
+         }
+     }
+
+     std::vector<Document> results() {
+         std::vector<Document> nearest;
+         for (; !best_docs.empty(); best_docs.pop()) nearest.push_back(tree->docs[best_docs.top().doc]);
+         std::reverse(nearest.begin(), nearest.end());
+         return nearest;
+     }
+ };
+
+ std::vector<std::vector<Document>> CoverTree::searchBatch(const std::vector<Document>& queries, int k, int inFlight) const {
+     std::vector<std::vector<Document>> results(queries.size());
+     if (root == -1 || k <= 0) return results;
+
+     std::vector<BatchSearch> searches;
+     searches.reserve(queries.size());
+     for (const auto& query : queries) searches.emplace_back(this, &query, k);
+     runInterleaved(searches, inFlight);
+     for (size_t i = 0; i < queries.size(); ++i) results[i] = searches[i].results();
+     return results;
+ }
+
+ //=============================================================================
+ // Flat Serialization
+ //=============================================================================
+
+ bool CoverTree::save(const std::string& path) const {
+     std::ofstream out(path, std::ios::binary);
+     if (!out.is_open()) {
+         std::cerr << "Error: Could not open " << path << " for writing." << std::endl;
+         return false;
+     }
+
+     uint32_t dims = docs.empty() ? 0 : (uint32_t)docs[0].features.size();
+     uint32_t numChildren = 0;
+     for (const auto& n : nodes) numChildren += (uint32_t)n.children.size();
+
+     out.write(COVER_TREE_MAGIC, sizeof(COVER_TREE_MAGIC));
+     writePod(out, COVER_TREE_VERSION);
+     writePod(out, dims);
+     writePod(out, (uint32_t)docs.size());
+     writePod(out, (uint32_t)nodes.size());
+     writePod(out, numChildren);
+     writePod(out, (int32_t)root);
+
+     uint32_t childBegin = 0;
+     for (const auto& n : nodes) {
+         CoverNodeRecord rec = {n.doc, n.level, n.maxDist, childBegin, (uint32_t)n.children.size()};
+         writePod(out, rec);
+         childBegin += rec.childCount;
+     }
+     for (const auto& n : nodes) {
+         for (int child : n.children) writePod(out, (int32_t)child);
+     }
+     for (const auto& d : docs) {
+         out.write(reinterpret_cast<const char*>(d.features.data()), dims * sizeof(float));
+     }
+     for (const auto& d : docs) {
+         writePod(out, (int32_t)d.id);
+         writePod(out, (uint32_t)d.filename.size());
+         out.write(d.filename.data(), d.filename.size());
+     }
+     return static_cast<bool>(out);
+ }
+
+ bool CoverTree::load(const std::string& path) {
+     std::ifstream in(path, std::ios::binary);
+     if (!in.is_open()) {
+         std::cerr << "Error: Could not open " << path << " for reading." << std::endl;
+         return false;
+     }
+
+     char magic[4];
+     uint32_t version, dims, numDocs, numNodes, numChildren;
+     int32_t rootIndex;
+     if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, COVER_TREE_MAGIC, sizeof(magic)) != 0 ||
+         !readPod(in, version) || version != COVER_TREE_VERSION ||
+         !readPod(in, dims) || !readPod(in, numDocs) || !readPod(in, numNodes) ||
+         !readPod(in, numChildren) || !readPod(in, rootIndex)) {
+         std::cerr << "Error: " << path << " is not a valid cover tree file." << std::endl;
+         return false;
+     }
+
+     // Bound every count by the bytes left before allocating anything for it.
+     std::streamoff headerEnd = in.tellg();
+     in.seekg(0, std::ios::end);
+     uint64_t remaining = (uint64_t)(in.tellg() - headerEnd);
+     in.seekg(headerEnd);
+     auto take = [&remaining](uint64_t count, uint64_t unitBytes) {
+         if (count > remaining / unitBytes) return false;
+         remaining -= count * unitBytes;
+         return true;
+     };
+     // Each document has at least its features, its id and its name length.
+     if (!take(numNodes, sizeof(CoverNodeRecord)) || !take(numChildren, sizeof(int32_t)) ||
+         !take(numDocs, (uint64_t)dims * sizeof(float) + sizeof(int32_t) + sizeof(uint32_t))) {
+         std::cerr << "Error: " << path << " is truncated." << std::endl;
+         return false;
+     }
+
+     std::vector<CoverNodeRecord> records(numNodes);
+     std::vector<int32_t> childIndex(numChildren);
+     in.read(reinterpret_cast<char*>(records.data()), numNodes * sizeof(CoverNodeRecord));
+     in.read(reinterpret_cast<char*>(childIndex.data()), numChildren * sizeof(int32_t));
+
+     std::vector<Document> loadedDocs(numDocs);
+     for (auto& d : loadedDocs) {
+         d.features.resize(dims);
+         in.read(reinterpret_cast<char*>(d.features.data()), dims * sizeof(float));
+     }
+     for (auto& d : loadedDocs) {
+         int32_t id;
+         uint32_t nameLen;
+         if (!readPod(in, id) || !readPod(in, nameLen) || nameLen > remaining) {
+             in.setstate(std::ios::failbit);
+             break;
+         }
+         remaining -= nameLen;
+         d.id = id;
+         d.filename.resize(nameLen);
+         in.read(&d.filename[0], nameLen);
+     }
+     if (!in) {
+         std::cerr << "Error: " << path << " is truncated." << std::endl;
+         return false;
+     }
+
+     // Searches index nodes and docs without checks, so every reference is validated here.
+     // An empty tree has no nodes and root -1.
+     bool rootValid = numNodes == 0 ? rootIndex == -1 : rootIndex >= 0 && (uint32_t)rootIndex < numNodes;
+     if (!rootValid) {
+         std::cerr << "Error: " << path << " has an out-of-range root." << std::endl;
+         return false;
+     }
+     for (int32_t child : childIndex) {
+         if (child < 0 || (uint32_t)child >= numNodes) {
+             std::cerr << "Error: " << path << " has an out-of-range child index." << std::endl;
+             return false;
+         }
+     }
+
+     HugePageVector<CoverNode> loadedNodes;
+     loadedNodes.reserve(numNodes);
+     for (const auto& rec : records) {
+         if (rec.doc < 0 || (uint32_t)rec.doc >= numDocs) {
+             std::cerr << "Error: " << path << " has an out-of-range document index." << std::endl;
+             return false;
+         }
+         if ((uint64_t)rec.childBegin + rec.childCount > numChildren) {
+             std::cerr << "Error: " << path << " has an out-of-range child list." << std::endl;
+             return false;
+         }
+         loadedNodes.emplace_back(rec.doc, rec.level);
+         loadedNodes.back().maxDist = rec.maxDist;
+         loadedNodes.back().children.assign(childIndex.begin() + rec.childBegin,
+                                            childIndex.begin() + rec.childBegin + rec.childCount);
+     }
+
+     // The recursive searches assume a tree: every node but the root has exactly one
+     // parent, one level above it. Strictly falling levels also rule out cycles.
+     std::vector<uint32_t> parents(numNodes, 0);
+     for (uint32_t n = 0; n < numNodes; ++n) {
+         for (int child : loadedNodes[n].children) {
+             if (++parents[child] > 1 || loadedNodes[child].level >= loadedNodes[n].level) {
+                 std::cerr << "Error: " << path << " does not hold a valid tree." << std::endl;
+                 return false;
+             }
+         }
+     }
+     for (uint32_t n = 0; n < numNodes; ++n) {
+         if (parents[n] != ((int32_t)n == rootIndex ? 0u : 1u)) {
+             std::cerr << "Error: " << path << " does not hold a valid tree." << std::endl;
+             return false;
+         }
+     }
+
+     docs = std::move(loadedDocs);
+     nodes = std::move(loadedNodes);
+     root = rootIndex;
+     return true;
+ }
@@ -6,35 +6,132 @@
 
  #include "DataStructures.h"
  #include <algorithm> // for std::sort
+ #include <cfloat>
+ #include <cstdint>
+ #include <limits>
  #include <queue>     // for std::priority_queue
  
  //=============================================================================
  // 1. DocumentList Implementation
  //=============================================================================
  
+ namespace {
+ 
+ // The k nearest of the documents whose distances the blocked kernel computed.
+ std::vector<Document> nearestOf(const std::vector<Document>& docs, const std::vector<float>& dist, int k) {
+     std::vector<size_t> order(docs.size());
+     for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+     size_t result_count = std::min(order.size(), (size_t)std::max(k, 0));
+     // Ties go to the earlier document, so searchBatch can reproduce the order.
+     std::partial_sort(order.begin(), order.begin() + result_count, order.end(), [&](size_t a, size_t b) {
+         return dist[a] < dist[b] || (dist[a] == dist[b] && a < b);
+     });
+ 
+     std::vector<Document> results;
+     for (size_t i = 0; i < result_count; ++i) {
+         results.push_back(docs[order[i]]);
+     }
+     return results;
+ }
+ 
+ } // namespace
+ 
  void DocumentList::insert(const Document& d) {
      docs.push_back(d);
+     blocks.append(d.features);
+ }
+ 
+ bool DocumentList::remove(int id) {
+     auto it = std::find_if(docs.begin(), docs.end(), [id](const Document& doc) { return doc.id == id; });
+     if (it == docs.end()) return false;
+     // Swap-remove, mirrored in the blocked features.
+     blocks.removeSwap(it - docs.begin());
+     *it = std::move(docs.back());
+     docs.pop_back();
+     return true;
  }
  
  std::vector<Document> DocumentList::searchSimilar(const Document& query, int k) {
      if (docs.empty()) return {};
  
-     std::vector<DocDist> distances;
-     for (const auto& doc : docs) {
-         float dist = euclideanDistance(query.features, doc.features);
-         distances.push_back({doc, dist});
+     // Distances to FeatureBlocks::LANES documents at a time.
+     std::vector<float> distances(docs.size());
+     blocks.distances(metric, query.features.data(), distances.data());
+     return nearestOf(docs, distances, k);
+ }
+ 
+ std::vector<std::vector<Document>> DocumentList::searchBatch(const std::vector<Document>& queries, int k) {
+     std::vector<std::vector<Document>> results(queries.size());
+     if (docs.empty() || k <= 0) return results;
+     if (metric != Metric::Euclidean) {
+         for (size_t i = 0; i < queries.size(); ++i) results[i] = searchSimilar(queries[i], k);
+         return results;
      }
  
-     // Sort by distance to find the nearest neighbors
-     std::sort(distances.begin(), distances.end(), [](const DocDist& a, const DocDist& b) {
-         return a.dist < b.dist;
-     });
+     // Queries are answered in batches whose distance matrix (about 4 MB) stays in cache
+     // until the selection below reads it back.
+     size_t batch = std::max<size_t>(FeatureBlocks::QUERY_TILE, std::min<size_t>(256, (1u << 20) / docs.size()));
+     size_t result_count = std::min(docs.size(), (size_t)k);
+     // Bound on |decomposed - exact| per unit of |q|^2 + |x|^2: the rounding of a
+     // dims-term dot product and of the norms, with a wide margin.
+     const float error_scale = (blocks.dimensions() + 4) * FLT_EPSILON;
+     float max_norm = 0.0f;
+     for (size_t d = 0; d < docs.size(); ++d) max_norm = std::max(max_norm, blocks.squaredNorm(d));
+     std::vector<float> squared, upper;
+     std::vector<size_t> candidates;
+     std::vector<std::pair<float, size_t>> ranked;
+     float lanes[FeatureBlocks::LANES];
+     std::vector<const float*> pointers;
+     for (size_t first = 0; first < queries.size(); first += batch) {
+         size_t count = std::min(batch, queries.size() - first);
+         pointers.clear();
+         for (size_t i = 0; i < count; ++i) pointers.push_back(queries[first + i].features.data());
+         squared.resize(count * docs.size());
+         blocks.batchSquaredDistances(pointers.data(), (int)count, squared.data());
  
-     std::vector<Document> results;
-     // Ensure we don't try to access more results than we have
-     int result_count = std::min(k, (int)distances.size());
-     for (int i = 0; i < result_count; ++i) {
-         results.push_back(distances[i].doc);
+         for (size_t i = 0; i < count; ++i) {
+             const float* row = &squared[i * docs.size()];
+             const float* query = pointers[i];
+             float query_norm = 0.0f;
+             for (int j = 0; j < blocks.dimensions(); ++j) query_norm += query[j] * query[j];
+ 
+             // The k-th smallest upper bound caps the exact k-th distance; only a
+             // document whose lower bound is within that cap can be among the k nearest.
+             // A bounded max-heap of upper bounds rejects most documents with one compare.
+             upper.clear();
+             for (size_t d = 0; d < docs.size(); ++d) {
+                 float bound = row[d] + error_scale * (query_norm + blocks.squaredNorm(d));
+                 if (upper.size() < result_count) {
+                     upper.push_back(bound);
+                     std::push_heap(upper.begin(), upper.end());
+                 } else if (bound < upper.front()) {
+                     std::pop_heap(upper.begin(), upper.end());
+                     upper.back() = bound;
+                     std::push_heap(upper.begin(), upper.end());
+                 }
+             }
+             float cap = upper.front();
+             float widest = cap + error_scale * (query_norm + max_norm); // Screens with one compare.
+             candidates.clear();
+             for (size_t d = 0; d < docs.size(); ++d) {
+                 if (row[d] <= widest && row[d] - error_scale * (query_norm + blocks.squaredNorm(d)) <= cap) candidates.push_back(d);
+             }
+ 
+             // Exact re-ranking with the blocked kernel of searchSimilar; candidates
+             // are in document order, so each block is computed once.
+             ranked.clear();
+             size_t computed_block = SIZE_MAX;
+             for (size_t d : candidates) {
+                 size_t block = d / FeatureBlocks::LANES;
+                 if (block != computed_block) {
+                     blocks.blockDistances(Metric::Euclidean, query, block, lanes);
+                     computed_block = block;
+                 }
+                 ranked.push_back({lanes[d % FeatureBlocks::LANES], d});
+             }
+             std::partial_sort(ranked.begin(), ranked.begin() + std::min(result_count, ranked.size()), ranked.end());
+             for (size_t c = 0; c < ranked.size() && c < result_count; ++c) results[first + i].push_back(docs[ranked[c].second]);
+         }
      }
      return results;
  }
@@ -46,6 +143,23 @@
  
  void KdTree::insert(const Document& d) {
      insertRec(root, d, 0);
+     liveCount++;
+ }
+ 
+ bool KdTree::remove(const Document& d) {
+     // Follow the insertion path; equal coordinates were sent right, so only that side can hold d.
+     KdNode* node = root;
+     for (int depth = 0; node != nullptr; depth++) {
+         if (!node->deleted && node->doc.id == d.id) {
+             node->deleted = true;
+             liveCount--;
+             deletedCount++;
+             return true;
+         }
+         int axis = depth % k;
+         node = d.features[axis] < node->doc.features[axis] ? node->left : node->right;
+     }
+     return false;
  }
  
  void KdTree::insertRec(KdNode*& node, Document d, int depth) {
@@ -61,7 +175,7 @@
      }
  }
  
- std::vector<Document> KdTree::searchSimilar(const Document& query, int k) {
+ std::vector<Document> KdTree::searchSimilar(const Document& query, int k) const {
      if (root == nullptr) return {};
  
      std::priority_queue<DocDist> best_docs;
@@ -81,13 +195,15 @@
  void KdTree::searchSimilarRec(KdNode* node, const Document& query, int k, std::priority_queue<DocDist>& best_docs, int depth) const {
      if (node == nullptr) return;
  
-     float dist = euclideanDistance(query.features, node->doc.features);
+     if (!node->deleted) {
+         float dist = featureDistance(metric, query.features, node->doc.features);
  
-     if (best_docs.size() < (size_t)k) {
-         best_docs.push({node->doc, dist});
-     } else if (dist < best_docs.top().dist) {
-         best_docs.pop();
-         best_docs.push({node->doc, dist});
+         if (best_docs.size() < (size_t)k) {
+             best_docs.push({node->doc, dist});
+         } else if (dist < best_docs.top().dist) {
+             best_docs.pop();
+             best_docs.push({node->doc, dist});
+         }
      }
  
      int axis = depth % this->k; // FIX: Was k_dims, now matches header
@@ -103,17 +219,237 @@
          searchSimilarRec(farChild, query, k, best_docs, depth + 1);
      }
  }
+
+ namespace {
+
+ // A candidate of the batched searches. The heap orders by distance only, like
+ // DocDist, but holds the node instead of copying its document on every push.
+ struct NodeCandidate {
+     const KdNode* node;
+     float dist;
+     bool operator<(const NodeCandidate& other) const { return dist < other.dist; }
+ };
+
+ std::vector<Document> nearestFirst(std::priority_queue<NodeCandidate>& best_docs) {
+     std::vector<Document> nearest;
+     for (; !best_docs.empty(); best_docs.pop()) nearest.push_back(best_docs.top().node->doc);
+     std::reverse(nearest.begin(), nearest.end());
+     return nearest;
+ }
+
+ } // namespace
+
+ // searchSimilarRec unrolled onto an explicit stack. The far child is pushed
+ // beneath the near one with its plane distance and tested only when popped,
+ // after the near subtree, exactly where the recursion tests it.
+ struct KdTree::BatchSearch {
+     struct Frame {
+         const KdNode* node;
+         int depth;
+         double planeDist; // Negative for a near child, which is always visited.
+     };
+     const KdTree* tree;
+     const Document* query;
+     size_t k;
+     std::vector<Frame> stack;
+     std::priority_queue<NodeCandidate> best_docs;
+     Frame current = {nullptr, 0, -1.0};
+     int stage = 0; // 0: pick the next node; 1: the node has arrived; 2: its features have arrived.
+
+     BatchSearch(const KdTree* t, const Document* q, int kNearest) : tree(t), query(q), k(kNearest) {
+         stack.push_back({t->root, 0, -1.0});
+     }
+
+     bool step() {
+         if (stage == 1) {
+             const std::vector<float>& features = current.node->doc.features;
+             prefetchRange(features.data(), features.size() * sizeof(float));
+             stage = 2;
+             return true;
+         }
+         if (stage == 2) visit();
+
+         while (!stack.empty()) {
+             Frame frame = stack.back();
+             stack.pop_back();
+             if (frame.planeDist >= 0 && best_docs.size() >= k && !(frame.planeDist < best_docs.top().dist)) continue;
+             current = frame;
+             prefetchObject(frame.node);
+             stage = 1;
+             return true;
+         }
+         stage = 0;
+         return false;
+     }
+
+     void visit() {
+         const KdNode* node = current.node;
+         if (!node->deleted) {
+             float dist = featureDistance(tree->metric, query->features, node->doc.features);
+             if (best_docs.size() < k) {
+                 best_docs.push({node, dist});
+             } else if (dist < best_docs.top().dist) {
+                 best_docs.pop();
+                 best_docs.push({node, dist});
+             }
+         }
+
+         int axis = current.depth % tree->k;
+         double diff = query->features[axis] - node->doc.features[axis];
+         const KdNode* nearChild = (diff < 0) ? node->left : node->right;
+         const KdNode* farChild = (diff < 0) ? node->right : node->left;
+         if (farChild != nullptr) stack.push_back({farChild, current.depth + 1, std::abs(diff)});
+         if (nearChild != nullptr) stack.push_back({nearChild, current.depth + 1, -1.0});
+     }
+
+     std::vector<Document> results() { return nearestFirst(best_docs); }
+ };
+
+ std::vector<std::vector<Document>> KdTree::searchBatch(const std::vector<Document>& queries, int k, int inFlight) const {
+     std::vector<std::vector<Document>> results(queries.size());
+     if (root == nullptr || k <= 0) return results;
+
+     std::vector<BatchSearch> searches;
+     searches.reserve(queries.size());
+     for (const auto& query : queries) searches.emplace_back(this, &query, k);
+     runInterleaved(searches, inFlight);
+     for (size_t i = 0; i < queries.size(); ++i) results[i] = searches[i].results();
+     return results;
+ }
+
+ namespace {
+
+ typedef float PacketLanes __attribute__((vector_size(KD_PACKET_SIZE * sizeof(float))));
+ typedef int32_t PacketMask __attribute__((vector_size(KD_PACKET_SIZE * sizeof(float))));
+
+ unsigned bitsOf(PacketMask lanes) {
+     unsigned bits = 0;
+     for (int l = 0; l < KD_PACKET_SIZE; l++) bits |= (lanes[l] != 0 ? 1u : 0u) << l;
+     return bits;
+ }
+
+ } // namespace
+
+ struct KdTree::Packet {
+     const Document* queries[KD_PACKET_SIZE];
+     std::vector<PacketLanes> coords; // coords[j][lane]: coordinate j of each query, transposed.
+     std::priority_queue<NodeCandidate> best_docs[KD_PACKET_SIZE];
+     PacketLanes bound; // The K-th best distance per query; infinity until K are found.
+     size_t k;
+
+     void offer(int lane, const KdNode* node, float dist) {
+         std::priority_queue<NodeCandidate>& best = best_docs[lane];
+         if (best.size() < k) {
+             best.push({node, dist});
+         } else if (dist < best.top().dist) {
+             best.pop();
+             best.push({node, dist});
+         }
+         if (best.size() >= k) bound[lane] = best.top().dist;
+     }
+ };
+
+ std::vector<std::vector<Document>> KdTree::searchPacket(const std::vector<Document>& queries, int k) const {
+     std::vector<std::vector<Document>> results(queries.size());
+     if (root == nullptr || k <= 0) return results;
+
+     // Packets only share work while their queries take the same branches, so
+     // queries are grouped by the path of their first 64 descents from the root.
+     std::vector<std::pair<uint64_t, size_t>> order(queries.size());
+     for (size_t i = 0; i < queries.size(); ++i) {
+         uint64_t path = 0;
+         const KdNode* node = root;
+         for (int depth = 0; depth < 64; depth++) {
+             bool right = node != nullptr && !(queries[i].features[depth % this->k] < node->doc.features[depth % this->k]);
+             path = (path << 1) | (right ? 1u : 0u);
+             if (node != nullptr) node = right ? node->right : node->left;
+         }
+         order[i] = {path, i};
+     }
+     std::sort(order.begin(), order.end());
+
+     Packet packet;
+     packet.k = k;
+     packet.coords.resize(this->k);
+     for (size_t first = 0; first < queries.size(); first += KD_PACKET_SIZE) {
+         int count = (int)std::min<size_t>(KD_PACKET_SIZE, queries.size() - first);
+         for (int l = 0; l < KD_PACKET_SIZE; l++) {
+             // Unused lanes repeat the last query; their mask bit is never set.
+             packet.queries[l] = &queries[order[first + std::min(l, count - 1)].second];
+             for (int j = 0; j < this->k; j++) packet.coords[j][l] = packet.queries[l]->features[j];
+             packet.bound[l] = std::numeric_limits<float>::infinity();
+         }
+         searchPacketRec(root, 0, (1u << count) - 1, packet);
+         for (int l = 0; l < count; l++) results[order[first + l].second] = nearestFirst(packet.best_docs[l]);
+     }
+     return results;
+ }
+
+ void KdTree::searchPacketRec(const KdNode* node, int depth, unsigned mask, Packet& packet) const {
+     if (node == nullptr || mask == 0) return;
+
+     if (!node->deleted) {
+         for (unsigned active = mask; active != 0; active &= active - 1) {
+             int lane = __builtin_ctz(active);
+             packet.offer(lane, node, featureDistance(metric, packet.queries[lane]->features, node->doc.features));
+         }
+     }
+
+     // The plane test of the whole packet, as in searchSimilarRec: diff < 0 sends a query left first.
+     int axis = depth % this->k;
+     PacketLanes diff = packet.coords[axis] - node->doc.features[axis];
+     PacketLanes planeDist = diff < 0 ? -diff : diff;
+     unsigned leftNear = mask & bitsOf(diff < 0);
+     unsigned rightNear = mask & ~leftNear;
+
+     searchPacketRec(node->left, depth + 1, leftNear, packet);
+     // The bounds are re-read after each pass: a query's far side is tested once its near side is done.
+     searchPacketRec(node->right, depth + 1, rightNear | (leftNear & bitsOf(planeDist < packet.bound)), packet);
+     searchPacketRec(node->left, depth + 1, rightNear & bitsOf(planeDist < packet.bound), packet);
+ }
  
  
  //=============================================================================
  // 3. DocumentHash (LSH) Implementation
  //=============================================================================
  
- DocumentHash::DocumentHash(int dimensions, int nHashes, float width)
-     : bucketWidth(width), numHashes(nHashes) {
+ namespace {
+ 
+ // In-place, unnormalized fast Walsh-Hadamard transform; the size must be a power of two.
+ void hadamardTransform(std::vector<float>& v) {
+     for (size_t len = 1; len < v.size(); len <<= 1) {
+         for (size_t i = 0; i < v.size(); i += len << 1) {
+             for (size_t j = i; j < i + len; ++j) {
+                 float a = v[j], b = v[j + len];
+                 v[j] = a + b;
+                 v[j + len] = a - b;
+             }
+         }
+     }
+ }
+ 
+ const int CROSS_POLYTOPE_ROUNDS = 3; // Three HD rounds approximate a random rotation well.
+ 
+ } // namespace
+ 
+ DocumentHash::DocumentHash(int dimensions, int nHashes, float width, HashFamily hashFamily, unsigned seed)
+     : family(hashFamily), paddedDims(1), bucketWidth(width), numHashes(nHashes) {
      // FIX: Corrected typo from mt1997 to mt19937
-     std::mt19937 gen(std::random_device{}());
+     std::mt19937 gen(seed);
      std::normal_distribution<float> dist(0.0, 1.0);
+ 
+     if (family == HashFamily::CrossPolytope) {
+         // Pseudo-random rotation: (H D3)(H D2)(H D1), with D random +-1 diagonals.
+         while (paddedDims < dimensions) paddedDims <<= 1;
+         std::bernoulli_distribution coin(0.5);
+         rotations.resize(numHashes);
+         for (int i = 0; i < numHashes; ++i) {
+             rotations[i].resize(CROSS_POLYTOPE_ROUNDS * paddedDims);
+             for (auto& sign : rotations[i]) sign = coin(gen) ? 1.0f : -1.0f;
+         }
+         return;
+     }
+ 
      projections.resize(numHashes);
      for (int i = 0; i < numHashes; ++i) {
          projections[i].resize(dimensions);
@@ -121,49 +457,80 @@
              projections[i][j] = dist(gen);
          }
      }
+     if (family == HashFamily::E2LSH) {
+         std::uniform_real_distribution<float> offset(0.0f, bucketWidth);
+         offsets.resize(numHashes);
+         for (auto& b : offsets) b = offset(gen);
+     }
  }
  
  void DocumentHash::insert(const Document& d) {
      std::vector<int> key = getHashKey(d.features);
-     buckets[key].push_back(d);
+     HashBucket& bucket = buckets[key];
+     bucket.docs.push_back(d);
+     bucket.blocks.append(d.features);
+ }
+ 
+ bool DocumentHash::remove(const Document& d) {
+     auto bucket = buckets.find(getHashKey(d.features));
+     if (bucket == buckets.end()) return false;
+     std::vector<Document>& docs = bucket->second.docs;
+     auto it = std::find_if(docs.begin(), docs.end(), [&](const Document& doc) { return doc.id == d.id; });
+     if (it == docs.end()) return false;
+     bucket->second.blocks.removeSwap(it - docs.begin());
+     *it = std::move(docs.back());
+     docs.pop_back();
+     if (docs.empty()) buckets.erase(bucket);
+     return true;
  }
  
  std::vector<int> DocumentHash::getHashKey(const std::vector<float>& features) const {
      std::vector<int> key;
      key.reserve(numHashes);
+ 
+     if (family == HashFamily::CrossPolytope) {
+         std::vector<float> rotated(paddedDims);
+         for (int i = 0; i < numHashes; ++i) {
+             std::fill(rotated.begin(), rotated.end(), 0.0f);
+             std::copy(features.begin(), features.end(), rotated.begin());
+             for (int r = 0; r < CROSS_POLYTOPE_ROUNDS; ++r) {
+                 for (int j = 0; j < paddedDims; ++j) rotated[j] *= rotations[i][r * paddedDims + j];
+                 hadamardTransform(rotated);
+             }
+             // The hash is the nearest vertex of the cross-polytope {+-e_j}.
+             int best = 0;
+             for (int j = 1; j < paddedDims; ++j) {
+                 if (std::abs(rotated[j]) > std::abs(rotated[best])) best = j;
+             }
+             key.push_back(rotated[best] >= 0 ? 2 * best : 2 * best + 1);
+         }
+         return key;
+     }
+ 
      for (int i = 0; i < numHashes; ++i) {
          float dotProduct = 0;
          for (size_t j = 0; j < features.size(); ++j) {
              dotProduct += features[j] * projections[i][j];
          }
+         if (family == HashFamily::E2LSH) dotProduct += offsets[i];
          key.push_back(static_cast<int>(floor(dotProduct / bucketWidth)));
      }
      return key;
  }
  
- std::vector<Document> DocumentHash::searchSimilar(const Document& query, int k) {
-     std::vector<int> queryKey = getHashKey(query.features);
-     
-     if (buckets.find(queryKey) == buckets.end() || buckets.at(queryKey).empty()) {
-         return {};
-     }
+ size_t DocumentHash::candidateCount(const Document& query) const {
+     auto it = buckets.find(getHashKey(query.features));
+     return it == buckets.end() ? 0 : it->second.docs.size();
+ }
  
-     std::vector<DocDist> distances;
-     for (const auto& doc : buckets.at(queryKey)) {
-         float dist = euclideanDistance(query.features, doc.features);
-         distances.push_back({doc, dist});
+ std::vector<Document> DocumentHash::searchSimilar(const Document& query, int k) const {
+     auto bucket = buckets.find(getHashKey(query.features));
+     if (bucket == buckets.end() || bucket->second.docs.empty()) {
+         return {};
      }
  
-     std::sort(distances.begin(), distances.end(), [](const DocDist& a, const DocDist& b) {
-         return a.dist < b.dist;
-     });
- 
-     std::vector<Document> results;
-     int result_count = std::min(k, (int)distances.size());
-     for (int i = 0; i < result_count; ++i) {
-         results.push_back(distances[i].doc);
-     }
-     return results;
+     // Re-rank the bucket with the blocked kernel.
+     std::vector<float> distances(bucket->second.docs.size());
+     bucket->second.blocks.distances(Metric::Euclidean, query.features.data(), distances.data());
+     return nearestOf(bucket->second.docs, distances, k);
  }
- 
- 
\ No newline at end of file
@@ -0,0 +1,155 @@
+/**
+ * @file DirectoryWatcher.cpp
+ * @brief Implements the inotify directory watcher.
+ */
+
+ #include "DirectoryWatcher.h"
+ #include <cerrno>
+ #include <chrono>
+ #include <iostream>
+
+ #include <dirent.h>
+ #include <poll.h>
+ #include <sys/inotify.h>
+ #include <sys/stat.h>
+ #include <unistd.h>
+
+ namespace {
+
+ // Only finished files are reported: IN_CLOSE_WRITE instead of IN_MODIFY, so a
+ // file being copied in is extracted once, after its last write.
+ const uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE;
+
+ bool statFile(const std::string& path, std::pair<uint64_t, int64_t>& stamp) {
+     struct stat st;
+     if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return false;
+     stamp = {(uint64_t)st.st_size, (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec};
+     return true;
+ }
+
+ } // namespace
+
+ DirectoryWatcher::~DirectoryWatcher() {
+     stop();
+ }
+
+ bool DirectoryWatcher::start(const std::string& dir) {
+     stop();
+     fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+     if (fd < 0) {
+         std::cerr << "Error: Could not initialize inotify." << std::endl;
+         return false;
+     }
+     if (inotify_add_watch(fd, dir.c_str(), WATCH_MASK) < 0) {
+         std::cerr << "Error: Could not watch the directory " << dir << "." << std::endl;
+         stop();
+         return false;
+     }
+     directory = dir;
+     buffer.resize(64 * 1024);
+     overflowed = false;
+     // The baseline for a rescan: the files present when watching began.
+     known.clear();
+     std::vector<FileEvent> initial;
+     std::unordered_map<std::string, size_t> index;
+     rescan(initial, index);
+     return true;
+ }
+
+ void DirectoryWatcher::stop() {
+     if (fd >= 0) close(fd); // Closing the descriptor also removes its watches.
+     fd = -1;
+ }
+
+ bool DirectoryWatcher::drain(std::vector<FileEvent>& events, std::unordered_map<std::string, size_t>& index) {
+     for (;;) {
+         ssize_t length = read(fd, buffer.data(), buffer.size());
+         if (length < 0) return errno == EAGAIN || errno == EINTR;
+         if (length == 0) return true;
+
+         for (ssize_t offset = 0; offset < length;) {
+             const inotify_event* ev = reinterpret_cast<const inotify_event*>(buffer.data() + offset);
+             offset += sizeof(inotify_event) + ev->len;
+             if (ev->mask & IN_Q_OVERFLOW) {
+                 std::cerr << "Warning: inotify queue overflowed; rescanning " << directory << "." << std::endl;
+                 overflowed = true;
+             }
+             if (ev->len == 0 || (ev->mask & IN_ISDIR)) continue;
+
+             FileEvent::Type type = (ev->mask & (IN_DELETE | IN_MOVED_FROM)) ? FileEvent::Type::Removed
+                                                                            : FileEvent::Type::Changed;
+             record(events, index, type, directory + "/" + ev->name);
+         }
+     }
+ }
+
+ void DirectoryWatcher::record(std::vector<FileEvent>& events, std::unordered_map<std::string, size_t>& index,
+                               FileEvent::Type type, std::string path) {
+     // Later notifications about the same file replace earlier ones.
+     auto it = index.find(path);
+     if (it != index.end()) {
+         events[it->second].type = type;
+     } else {
+         index.emplace(path, events.size());
+         events.push_back({type, std::move(path)});
+     }
+ }
+
+ void DirectoryWatcher::rescan(std::vector<FileEvent>& events, std::unordered_map<std::string, size_t>& index) {
+     DIR* dir = opendir(directory.c_str());
+     if (dir == nullptr) {
+         std::cerr << "Error: Could not list the directory " << directory << "." << std::endl;
+         return;
+     }
+     std::unordered_map<std::string, std::pair<uint64_t, int64_t>> present;
+     while (const dirent* entry = readdir(dir)) {
+         std::string path = directory + "/" + entry->d_name;
+         std::pair<uint64_t, int64_t> stamp;
+         if (statFile(path, stamp)) present.emplace(std::move(path), stamp);
+     }
+     closedir(dir);
+
+     for (const auto& file : known) {
+         if (present.count(file.first) == 0) record(events, index, FileEvent::Type::Removed, file.first);
+     }
+     for (const auto& file : present) {
+         auto it = known.find(file.first);
+         if (it == known.end() || it->second != file.second) record(events, index, FileEvent::Type::Changed, file.first);
+     }
+     known = std::move(present);
+ }
+
+ std::vector<FileEvent> DirectoryWatcher::poll(int waitMs, int batchMs) {
+     std::vector<FileEvent> events;
+     std::unordered_map<std::string, size_t> index;
+     if (fd < 0) return events;
+
+     pollfd pfd = {fd, POLLIN, 0};
+     if (::poll(&pfd, 1, waitMs) <= 0) return events;
+
+     auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(batchMs);
+     for (;;) {
+         if (!drain(events, index)) {
+             std::cerr << "Error: Could not read inotify events." << std::endl;
+             break;
+         }
+         auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+         if (remaining.count() <= 0 || ::poll(&pfd, 1, (int)remaining.count()) <= 0) break;
+     }
+
+     if (overflowed) {
+         // The rescan reports everything the lost notifications would have.
+         overflowed = false;
+         rescan(events, index);
+         return events;
+     }
+     for (const auto& event : events) {
+         std::pair<uint64_t, int64_t> stamp;
+         if (event.type == FileEvent::Type::Changed && statFile(event.path, stamp)) {
+             known[event.path] = stamp;
+         } else {
+             known.erase(event.path);
+         }
+     }
+     return events;
+ }
@@ -0,0 +1,211 @@
+/**
+ * @file DualTree.cpp
+ * @brief Implements the bounding-box kd-tree and the parallel dual-tree K-NN search.
+ */
+
+ #include "DualTree.h"
+ #include <algorithm> // for std::nth_element, std::max
+ #include <atomic>
+ #include <cmath>
+ #include <limits>
+ #include <queue>
+ #include <thread>
+
+ //=============================================================================
+ // Bounding-Box Tree
+ //=============================================================================
+
+ namespace {
+
+ int buildNode(BoxTree& tree, const std::vector<Document>& docs, uint32_t begin, uint32_t count, int leafSize) {
+     int index = (int)tree.nodes.size();
+     tree.nodes.push_back({-1, -1, begin, count});
+
+     // The box is written before recursing: the children's boxes reallocate the array.
+     int dims = tree.dims;
+     tree.boxes.resize(tree.boxes.size() + 2 * dims);
+     float* lower = &tree.boxes[(size_t)index * 2 * dims];
+     float* upper = lower + dims;
+     for (int j = 0; j < dims; j++) {
+         lower[j] = std::numeric_limits<float>::infinity();
+         upper[j] = -std::numeric_limits<float>::infinity();
+     }
+     for (uint32_t i = begin; i < begin + count; i++) {
+         const std::vector<float>& f = docs[tree.original[i]].features;
+         for (int j = 0; j < dims; j++) {
+             lower[j] = std::min(lower[j], f[j]);
+             upper[j] = std::max(upper[j], f[j]);
+         }
+     }
+     if (count <= (uint32_t)leafSize) return index;
+
+     int axis = 0;
+     for (int j = 1; j < dims; j++) {
+         if (upper[j] - lower[j] > upper[axis] - lower[axis]) axis = j;
+     }
+     uint32_t mid = begin + count / 2;
+     std::nth_element(tree.original.begin() + begin, tree.original.begin() + mid, tree.original.begin() + begin + count,
+                      [&](uint32_t a, uint32_t b) { return docs[a].features[axis] < docs[b].features[axis]; });
+
+     int left = buildNode(tree, docs, begin, mid - begin, leafSize);
+     int right = buildNode(tree, docs, mid, begin + count - mid, leafSize);
+     tree.nodes[index].left = left;
+     tree.nodes[index].right = right;
+     return index;
+ }
+
+ } // namespace
+
+ void BoxTree::build(const std::vector<Document>& docs, int leafSize) {
+     nodes.clear();
+     boxes.clear();
+     points.clear();
+     original.resize(docs.size());
+     for (size_t i = 0; i < docs.size(); ++i) original[i] = (uint32_t)i;
+     dims = docs.empty() ? 0 : (int)docs[0].features.size();
+     if (docs.empty()) return;
+
+     buildNode(*this, docs, 0, (uint32_t)docs.size(), std::max(leafSize, 1));
+     points.resize(docs.size() * dims);
+     for (size_t i = 0; i < docs.size(); ++i) {
+         std::copy(docs[original[i]].features.begin(), docs[original[i]].features.end(), &points[i * dims]);
+     }
+ }
+
+ //=============================================================================
+ // Dual-Tree Search
+ //=============================================================================
+
+ namespace {
+
+ // Distance between a box and a point or another box: the gaps only shrink the
+ // per-dimension differences, so the result never exceeds a true distance.
+ float boxDistance(const float* lowerA, const float* upperA, const float* lowerB, const float* upperB, int dims) {
+     float sum = 0.0f;
+     for (int j = 0; j < dims; j++) {
+         float gap = std::max(std::max(lowerB[j] - upperA[j], lowerA[j] - upperB[j]), 0.0f);
+         sum += gap * gap;
+     }
+     return std::sqrt(sum);
+ }
+
+ struct DualSearch {
+     typedef std::pair<float, uint32_t> Candidate; // Distance, corpus position.
+
+     const BoxTree& queries;
+     const BoxTree& corpus;
+     size_t k;
+     std::vector<std::priority_queue<Candidate>>& best;  // By query position.
+     std::vector<float>& queryBound;                     // K-th best distance by query position.
+     std::vector<float>& nodeBound;                      // Largest queryBound in each query node.
+
+     float distance(int queryNode, int corpusNode) const {
+         return boxDistance(queries.lower(queryNode), queries.upper(queryNode),
+                            corpus.lower(corpusNode), corpus.upper(corpusNode), queries.dims);
+     }
+
+     void traverse(int queryNode, int corpusNode, float minDist) {
+         if (minDist > nodeBound[queryNode]) return;
+         const BoxTree::Node& q = queries.nodes[queryNode];
+         const BoxTree::Node& r = corpus.nodes[corpusNode];
+
+         if (queries.isLeaf(queryNode) && corpus.isLeaf(corpusNode)) {
+             baseCase(queryNode, corpusNode);
+         } else if (queries.isLeaf(queryNode) || (!corpus.isLeaf(corpusNode) && r.count >= q.count)) {
+             // Split the corpus node, nearer child first so the bounds shrink early.
+             int nearChild = r.left, farChild = r.right;
+             float nearDist = distance(queryNode, nearChild), farDist = distance(queryNode, farChild);
+             if (farDist < nearDist) {
+                 std::swap(nearChild, farChild);
+                 std::swap(nearDist, farDist);
+             }
+             traverse(queryNode, nearChild, nearDist);
+             traverse(queryNode, farChild, farDist);
+         } else {
+             traverse(q.left, corpusNode, distance(q.left, corpusNode));
+             traverse(q.right, corpusNode, distance(q.right, corpusNode));
+             nodeBound[queryNode] = std::max(nodeBound[q.left], nodeBound[q.right]);
+         }
+     }
+
+     void baseCase(int queryNode, int corpusNode) {
+         const BoxTree::Node& q = queries.nodes[queryNode];
+         const BoxTree::Node& r = corpus.nodes[corpusNode];
+         int dims = queries.dims;
+         float largest = 0.0f;
+         for (uint32_t p = q.begin; p < q.begin + q.count; p++) {
+             const float* query = queries.point(p);
+             if (boxDistance(query, query, corpus.lower(corpusNode), corpus.upper(corpusNode), dims) <= queryBound[p]) {
+                 std::priority_queue<Candidate>& nearest = best[p];
+                 for (uint32_t c = r.begin; c < r.begin + r.count; c++) {
+                     float dist = euclideanDistance(query, corpus.point(c), dims);
+                     if (nearest.size() < k) {
+                         nearest.push({dist, c});
+                     } else if (dist < nearest.top().first) {
+                         nearest.pop();
+                         nearest.push({dist, c});
+                     }
+                 }
+                 if (nearest.size() >= k) queryBound[p] = nearest.top().first;
+             }
+             largest = std::max(largest, queryBound[p]);
+         }
+         nodeBound[queryNode] = largest;
+     }
+ };
+
+ } // namespace
+
+ void DualTreeKnn::build(const std::vector<Document>& corpusDocs) {
+     docs = corpusDocs;
+     corpus.build(docs, leafSize);
+ }
+
+ std::vector<std::vector<Document>> DualTreeKnn::search(const std::vector<Document>& queries, int k, int numThreads) const {
+     std::vector<std::vector<Document>> results(queries.size());
+     if (docs.empty() || queries.empty() || k <= 0) return results;
+
+     BoxTree queryTree;
+     queryTree.build(queries, leafSize);
+     std::vector<std::priority_queue<DualSearch::Candidate>> best(queries.size());
+     std::vector<float> queryBound(queries.size(), std::numeric_limits<float>::infinity());
+     std::vector<float> nodeBound(queryTree.nodes.size(), std::numeric_limits<float>::infinity());
+
+     // Split the query tree into disjoint subtrees, several per thread for balance.
+     // Each task writes only the bounds and heaps of its own queries.
+     if (numThreads <= 0) numThreads = std::max(1u, std::thread::hardware_concurrency());
+     std::vector<int> tasks = {0};
+     while (tasks.size() < (size_t)numThreads * 8) {
+         std::vector<int> next;
+         for (int node : tasks) {
+             if (queryTree.isLeaf(node)) {
+                 next.push_back(node);
+             } else {
+                 next.push_back(queryTree.nodes[node].left);
+                 next.push_back(queryTree.nodes[node].right);
+             }
+         }
+         if (next.size() == tasks.size()) break;
+         tasks.swap(next);
+     }
+
+     std::atomic<size_t> nextTask(0);
+     auto worker = [&]() {
+         DualSearch search = {queryTree, corpus, (size_t)k, best, queryBound, nodeBound};
+         for (size_t t = nextTask++; t < tasks.size(); t = nextTask++) {
+             search.traverse(tasks[t], 0, search.distance(tasks[t], 0));
+         }
+     };
+     numThreads = std::min<int>(numThreads, (int)tasks.size());
+     std::vector<std::thread> pool;
+     for (int i = 1; i < numThreads; ++i) pool.emplace_back(worker);
+     worker();
+     for (auto& th : pool) th.join();
+
+     for (uint32_t p = 0; p < queries.size(); ++p) {
+         std::vector<Document>& nearest = results[queryTree.original[p]];
+         for (; !best[p].empty(); best[p].pop()) nearest.push_back(docs[corpus.original[best[p].top().second]]);
+         std::reverse(nearest.begin(), nearest.end());
+     }
+     return results;
+ }
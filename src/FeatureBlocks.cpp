@@ -0,0 +1,169 @@
+/**
+ * @file FeatureBlocks.cpp
+ * @brief Implements the blocked feature layout and its LANES-wide distance kernel.
+ */
+
+ #include "FeatureBlocks.h"
+ #include <algorithm> // for std::copy
+ #include <cmath>
+ #include <cstdint>
+ #include <cstring>
+
+ void FeatureBlocks::append(const std::vector<float>& features) {
+     if (count == 0) dims = (int)features.size();
+     size_t lane = count % LANES;
+     if (lane == 0) data.resize(data.size() + (size_t)dims * LANES, 0.0f);
+     float* block = &data[(count / LANES) * dims * LANES];
+     float norm = 0.0f;
+     for (int j = 0; j < dims; j++) {
+         block[j * LANES + lane] = features[j];
+         norm += features[j] * features[j];
+     }
+     if (lane == 0) norms.resize(norms.size() + LANES, 0.0f);
+     norms[count] = norm;
+     count++;
+ }
+
+ void FeatureBlocks::removeSwap(size_t index) {
+     if (index >= count) return;
+     size_t last = count - 1;
+     float* lastBlock = &data[(last / LANES) * dims * LANES];
+     float* block = &data[(index / LANES) * dims * LANES];
+     for (int j = 0; j < dims; j++) {
+         block[j * LANES + index % LANES] = lastBlock[j * LANES + last % LANES];
+         lastBlock[j * LANES + last % LANES] = 0.0f;
+     }
+     norms[index] = norms[last];
+     norms[last] = 0.0f;
+     count = last;
+     data.resize(blocks() * dims * LANES);
+     norms.resize(blocks() * LANES);
+ }
+
+ void FeatureBlocks::clear() {
+     count = 0;
+     data.clear();
+     norms.clear();
+ }
+
+ namespace {
+
+ // One block row: dimension j of the LANES documents. GCC/Clang vector extensions
+ // pin the vectorization to the lanes; left to itself the auto-vectorizer may pick
+ // the dimension loop instead and reintroduce the shuffles this layout avoids.
+ typedef float LaneVector __attribute__((vector_size(FeatureBlocks::LANES * sizeof(float))));
+ typedef int32_t LaneBits __attribute__((vector_size(FeatureBlocks::LANES * sizeof(float))));
+
+ } // namespace
+
+ void FeatureBlocks::blockDistances(Metric metric, const float* query, size_t block, float* out) const {
+     const float* p = &data[block * dims * LANES];
+     LaneVector acc = {}, row;
+     // Pure vertical arithmetic. The dimensions are summed in order, as in
+     // euclideanDistance, so the lanes match it up to FMA contraction.
+     if (metric == Metric::Manhattan) {
+         for (int j = 0; j < dims; j++, p += LANES) {
+             std::memcpy(&row, p, sizeof(row));
+             LaneVector diff = row - query[j];
+             acc += (LaneVector)((LaneBits)diff & 0x7fffffff); // |diff|: clear the sign bits.
+         }
+         std::memcpy(out, &acc, sizeof(acc));
+         return;
+     }
+     for (int j = 0; j < dims; j++, p += LANES) {
+         std::memcpy(&row, p, sizeof(row));
+         LaneVector diff = row - query[j];
+         acc += diff * diff;
+     }
+     float squared[LANES];
+     std::memcpy(squared, &acc, sizeof(acc));
+     for (int l = 0; l < LANES; l++) out[l] = std::sqrt(squared[l]);
+ }
+
+ void FeatureBlocks::distances(Metric metric, const float* query, float* out) const {
+     size_t full = count / LANES;
+     for (size_t b = 0; b < full; b++) blockDistances(metric, query, b, out + b * LANES);
+     if (full * LANES < count) {
+         float tail[LANES];
+         blockDistances(metric, query, full, tail);
+         std::copy(tail, tail + (count - full * LANES), out + full * LANES);
+     }
+ }
+
+ namespace {
+
+ // Dot products of QUERY_TILE queries with the LANES * BLOCKS documents of
+ // consecutive blocks. The QUERY_TILE x BLOCKS accumulators stay in registers.
+ template <int BLOCKS>
+ void dotTile(const float* blocks, int dims, const float* const* queries, LaneVector (&acc)[FeatureBlocks::QUERY_TILE][BLOCKS]) {
+     const int LANES = FeatureBlocks::LANES;
+     for (int i = 0; i < FeatureBlocks::QUERY_TILE; i++) {
+         for (int b = 0; b < BLOCKS; b++) acc[i][b] = LaneVector{};
+     }
+     for (int j = 0; j < dims; j++) {
+         LaneVector row[BLOCKS];
+         for (int b = 0; b < BLOCKS; b++) std::memcpy(&row[b], blocks + ((size_t)b * dims + j) * LANES, sizeof(LaneVector));
+         for (int i = 0; i < FeatureBlocks::QUERY_TILE; i++) {
+             float q = queries[i][j];
+             for (int b = 0; b < BLOCKS; b++) acc[i][b] += row[b] * q;
+         }
+     }
+ }
+
+ } // namespace
+
+ void FeatureBlocks::batchSquaredDistances(const float* const* queries, int nQueries, float* out) const {
+     if (count == 0 || nQueries <= 0) return;
+     std::vector<float> queryNorms(nQueries, 0.0f);
+     for (int i = 0; i < nQueries; i++) {
+         for (int j = 0; j < dims; j++) queryNorms[i] += queries[i][j] * queries[i][j];
+     }
+
+     // Cache blocking: a chunk of blocks (about 96 KB of features at 24 dimensions)
+     // stays in L2 while every query tile passes over it.
+     const size_t CHUNK_BLOCKS = 128;
+     size_t numBlocks = blocks();
+     for (size_t chunk = 0; chunk < numBlocks; chunk += CHUNK_BLOCKS) {
+         size_t chunkEnd = std::min(numBlocks, chunk + CHUNK_BLOCKS);
+         for (int first = 0; first < nQueries; first += QUERY_TILE) {
+             int tileSize = std::min(QUERY_TILE, nQueries - first);
+             // A short tile repeats its last query; the extra rows are computed and dropped.
+             const float* tile[QUERY_TILE];
+             for (int i = 0; i < QUERY_TILE; i++) tile[i] = queries[first + std::min(i, tileSize - 1)];
+
+             // |q - x|^2 = |q|^2 + |x|^2 - 2 q.x, clamped at zero, for BLOCKS blocks from b.
+             LaneVector acc[QUERY_TILE][2];
+             auto store = [&](size_t b, int numStored) {
+                 for (int i = 0; i < tileSize; i++) {
+                     float* row = out + (size_t)(first + i) * count;
+                     for (int s = 0; s < numStored; s++) {
+                         size_t firstDoc = (b + s) * LANES;
+                         LaneVector norm, zero = {};
+                         std::memcpy(&norm, &norms[firstDoc], sizeof(norm));
+                         LaneVector d2 = (queryNorms[first + i] + norm) - 2.0f * acc[i][s];
+                         d2 = d2 > zero ? d2 : zero;
+                         if (firstDoc + LANES <= count) {
+                             std::memcpy(row + firstDoc, &d2, sizeof(d2));
+                         } else {
+                             float tail[LANES];
+                             std::memcpy(tail, &d2, sizeof(d2));
+                             std::copy(tail, tail + (count - firstDoc), row + firstDoc);
+                         }
+                     }
+                 }
+             };
+
+             size_t b = chunk;
+             for (; b + 2 <= chunkEnd; b += 2) {
+                 dotTile<2>(&data[b * dims * LANES], dims, tile, acc);
+                 store(b, 2);
+             }
+             if (b < chunkEnd) {
+                 LaneVector single[QUERY_TILE][1];
+                 dotTile<1>(&data[b * dims * LANES], dims, tile, single);
+                 for (int i = 0; i < QUERY_TILE; i++) acc[i][0] = single[i][0];
+                 store(b, 1);
+             }
+         }
+     }
+ }
@@ -0,0 +1,137 @@
+/**
+ * @file HugePages.cpp
+ * @brief Implements the page policy, huge-page mappings and the dTLB miss counter.
+ */
+
+ #include "HugePages.h"
+ #include <atomic>
+ #include <cstdint>
+ #include <cstring>
+ #include <fstream>
+ #include <iostream>
+
+ #include <linux/perf_event.h>
+ #include <sys/ioctl.h>
+ #include <sys/mman.h>
+ #include <sys/syscall.h>
+ #include <unistd.h>
+
+ namespace {
+
+ std::atomic<int> currentPolicy{(int)PagePolicy::System};
+ std::atomic<bool> warnedExplicit{false};
+
+ size_t roundUp(size_t bytes) {
+     return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+ }
+
+ } // namespace
+
+ void setPagePolicy(PagePolicy policy) {
+     currentPolicy.store((int)policy);
+ }
+
+ PagePolicy pagePolicy() {
+     return (PagePolicy)currentPolicy.load();
+ }
+
+ bool parsePagePolicy(const std::string& name, PagePolicy& policy) {
+     if (name == "system") policy = PagePolicy::System;
+     else if (name == "standard") policy = PagePolicy::Standard;
+     else if (name == "thp") policy = PagePolicy::Transparent;
+     else if (name == "explicit") policy = PagePolicy::Explicit;
+     else return false;
+     return true;
+ }
+
+ const char* pagePolicyName(PagePolicy policy) {
+     switch (policy) {
+         case PagePolicy::Transparent: return "Transparent huge pages (madvise)";
+         case PagePolicy::Explicit: return "Explicit huge pages (MAP_HUGETLB)";
+         case PagePolicy::Standard: return "Standard 4 KB pages";
+         default: return "System default (no madvise)";
+     }
+ }
+
+ //=============================================================================
+ // Mappings
+ //=============================================================================
+
+ void* allocatePages(size_t bytes) {
+     size_t length = roundUp(bytes);
+     PagePolicy policy = pagePolicy();
+
+     if (policy == PagePolicy::Explicit) {
+         void* pointer = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+         if (pointer != MAP_FAILED) return pointer;
+         if (!warnedExplicit.exchange(true)) {
+             std::cerr << "Warning: No explicit huge pages available (see /proc/sys/vm/nr_hugepages); "
+                       << "using transparent huge pages instead." << std::endl;
+         }
+         policy = PagePolicy::Transparent;
+     }
+
+     // Over-map by one huge page and trim, so the range is 2 MB aligned and the
+     // kernel can back all of it with huge pages.
+     void* raw = mmap(nullptr, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+     if (raw == MAP_FAILED) return nullptr;
+     uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+     uintptr_t aligned = (start + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+     if (aligned > start) munmap(raw, aligned - start);
+     size_t tail = start + length + HUGE_PAGE_SIZE - (aligned + length);
+     if (tail > 0) munmap(reinterpret_cast<void*>(aligned + length), tail);
+
+     void* pointer = reinterpret_cast<void*>(aligned);
+     if (policy != PagePolicy::System) {
+         madvise(pointer, length, policy == PagePolicy::Transparent ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+     }
+     return pointer;
+ }
+
+ void freePages(void* pointer, size_t bytes) {
+     if (pointer != nullptr) munmap(pointer, roundUp(bytes));
+ }
+
+ size_t residentHugePageBytes() {
+     std::ifstream smaps("/proc/self/smaps_rollup");
+     std::string key;
+     size_t kilobytes;
+     while (smaps >> key) {
+         if (key == "AnonHugePages:" && smaps >> kilobytes) return kilobytes * 1024;
+     }
+     return 0;
+ }
+
+ //=============================================================================
+ // dTLB Miss Counter
+ //=============================================================================
+
+ TlbMissCounter::TlbMissCounter() {
+     perf_event_attr attr;
+     std::memset(&attr, 0, sizeof(attr));
+     attr.size = sizeof(attr);
+     attr.type = PERF_TYPE_HW_CACHE;
+     attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+     attr.disabled = 1;
+     attr.exclude_kernel = 1;
+     attr.exclude_hv = 1;
+     fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+ }
+
+ TlbMissCounter::~TlbMissCounter() {
+     if (fd >= 0) close(fd);
+ }
+
+ void TlbMissCounter::start() {
+     if (fd < 0) return;
+     ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+     ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+ }
+
+ long long TlbMissCounter::stop() {
+     if (fd < 0) return -1;
+     ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+     long long count = 0;
+     if (read(fd, &count, sizeof(count)) != (ssize_t)sizeof(count)) return -1;
+     return count;
+ }
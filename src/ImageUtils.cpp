@@ -7,6 +7,12 @@
  */
 
  #include "ImageUtils.h"
+ #include <algorithm> // for std::min, std::max
+ #include <cstring>   // for std::memcpy
+
+ #include <fcntl.h>
+ #include <sys/stat.h>
+ #include <unistd.h>
 
  /**
   * @brief Calculates the Euclidean distance between two feature vectors.
@@ -14,15 +20,45 @@
   * @param b The second feature vector.
   * @return The L2 norm (Euclidean distance) between vectors a and b.
   */
- float euclideanDistance(const std::vector<float>& a, const std::vector<float>& b) {
+ float euclideanDistance(const float* a, const float* b, size_t n) {
      float sum = 0.0;
-     // Assuming vectors are of the same size, which is guaranteed by the histogram extraction.
-     for (size_t i = 0; i < a.size(); i++) {
+     for (size_t i = 0; i < n; i++) {
          float diff = a[i] - b[i];
          sum += diff * diff;
      }
      return sqrt(sum);
  }
+
+ float euclideanDistance(const std::vector<float>& a, const std::vector<float>& b) {
+     // Assuming vectors are of the same size, which is guaranteed by the histogram extraction.
+     return euclideanDistance(a.data(), b.data(), a.size());
+ }
+ 
+ float manhattanDistance(const float* a, const float* b, size_t n) {
+     float partial[8] = {};
+     size_t i = 0;
+     for (; i + 8 <= n; i += 8) {
+         for (int j = 0; j < 8; j++) partial[j] += std::fabs(a[i + j] - b[i + j]);
+     }
+     for (; i < n; i++) partial[0] += std::fabs(a[i] - b[i]);
+     return ((partial[0] + partial[1]) + (partial[2] + partial[3])) + ((partial[4] + partial[5]) + (partial[6] + partial[7]));
+ }
+ 
+ float manhattanDistance(const std::vector<float>& a, const std::vector<float>& b) {
+     return manhattanDistance(a.data(), b.data(), a.size());
+ }
+ 
+ void histogramToCdf(const float* histogram, float* cdf) {
+     for (int ch = 0; ch < 3; ch++) {
+         float mass = 0.0f;
+         for (int i = 0; i < HISTOGRAM_BINS; i++) mass += histogram[i * 3 + ch];
+         float running = 0.0f;
+         for (int i = 0; i < HISTOGRAM_BINS; i++) {
+             running += mass > 0.0f ? histogram[i * 3 + ch] / mass : 1.0f / HISTOGRAM_BINS;
+             cdf[i * 3 + ch] = running;
+         }
+     }
+ }
  
  /**
   * @brief Extracts a color histogram from an image to serve as its feature vector.
@@ -42,37 +78,367 @@
          return {}; // Return an empty vector on failure.
      }
  
-     // 2. Split the image into its 3 color channels (B, G, R).
-     std::vector<cv::Mat> bgr_planes;
-     cv::split(img, bgr_planes);
- 
-     // 3. Define parameters for the histogram calculation.
-     int histSize = 8;                // We want 8 bins per channel.
-     float range[] = {0, 256};        // The pixel value range [0, 255].
-     const float* histRange = {range};
-     bool uniform = true, accumulate = false;
- 
-     // 4. Calculate the histogram for each color channel.
-     cv::Mat b_hist, g_hist, r_hist;
-     cv::calcHist(&bgr_planes[0], 1, 0, cv::Mat(), b_hist, 1, &histSize, &histRange, uniform, accumulate);
-     cv::calcHist(&bgr_planes[1], 1, 0, cv::Mat(), g_hist, 1, &histSize, &histRange, uniform, accumulate);
-     cv::calcHist(&bgr_planes[2], 1, 0, cv::Mat(), r_hist, 1, &histSize, &histRange, uniform, accumulate);
- 
-     // 5. Normalize the histograms to a range of [0, 1].
-     // This is crucial for a fair comparison between images of different sizes.
-     cv::normalize(b_hist, b_hist, 0, 1, cv::NORM_MINMAX, -1, cv::Mat());
-     cv::normalize(g_hist, g_hist, 0, 1, cv::NORM_MINMAX, -1, cv::Mat());
-     cv::normalize(r_hist, r_hist, 0, 1, cv::NORM_MINMAX, -1, cv::Mat());
- 
-     // 6. Combine the 3 histograms into a single feature vector.
-     // The values are interleaved: [B0, G0, R0, B1, G1, R1, ...].
-     std::vector<float> features;
-     features.reserve(histSize * 3); // Pre-allocate memory for efficiency.
-     for (int i = 0; i < histSize; i++) {
-         features.push_back(b_hist.at<float>(i));
-         features.push_back(g_hist.at<float>(i));
-         features.push_back(r_hist.at<float>(i));
-     }
-     
+     // 2. Compute the per-channel histograms into the feature vector.
+     std::vector<float> features(HISTOGRAM_SIZE);
+     computeHistogram(img, features.data());
      return features;
- }
\ No newline at end of file
+ }
+ 
+ namespace {
+ 
+ const int BIN_SHIFT = 5; // log2(256 / HISTOGRAM_BINS): the bin of a pixel value is value >> 5.
+ 
+ // Adds the bin counts of the pixel block [r0, r1) x [c0, c1) to counts.
+ void countBlock(const cv::Mat& img, int r0, int r1, int c0, int c1, unsigned counts[3][HISTOGRAM_BINS]) {
+     for (int r = r0; r < r1; r++) {
+         const unsigned char* px = img.ptr<unsigned char>(r) + c0 * 3;
+         for (int c = c0; c < c1; c++, px += 3) {
+             counts[0][px[0] >> BIN_SHIFT]++;
+             counts[1][px[1] >> BIN_SHIFT]++;
+             counts[2][px[2] >> BIN_SHIFT]++;
+         }
+     }
+ }
+ 
+ } // namespace
+ 
+ void accumulateHistogram(const cv::Mat& img, unsigned counts[3][HISTOGRAM_BINS]) {
+     countBlock(img, 0, img.rows, 0, img.cols, counts);
+ }
+ 
+ void normalizeHistogram(const unsigned counts[3][HISTOGRAM_BINS], float* out) {
+     for (int ch = 0; ch < 3; ch++) {
+         unsigned lo = counts[ch][0], hi = counts[ch][0];
+         for (int i = 1; i < HISTOGRAM_BINS; i++) {
+             lo = std::min(lo, counts[ch][i]);
+             hi = std::max(hi, counts[ch][i]);
+         }
+         double scale = hi > lo ? 1.0 / (hi - lo) : 0.0;
+         for (int i = 0; i < HISTOGRAM_BINS; i++) {
+             out[i * 3 + ch] = (float)((counts[ch][i] - lo) * scale);
+         }
+     }
+ }
+ 
+ /**
+  * @brief Computes the normalized, interleaved color histogram of a decoded image.
+  *
+  * With 8 uniform bins over [0, 256), the bin of a pixel value is simply value >> 5,
+  * so the counts are gathered in a single pass without splitting the channels.
+  * Each channel is then min-max normalized to [0, 1], exactly like
+  * cv::normalize(..., 0, 1, cv::NORM_MINMAX) (a constant histogram becomes all zeros).
+  */
+ void computeHistogram(const cv::Mat& img, float* out) {
+     unsigned counts[3][HISTOGRAM_BINS] = {};
+     accumulateHistogram(img, counts);
+     normalizeHistogram(counts, out);
+ }
+ 
+ //=============================================================================
+ // IntegralHistogram Implementation
+ //=============================================================================
+ 
+ IntegralHistogram::IntegralHistogram(int gridResolution) : resolution(std::max(1, gridResolution)) {}
+ 
+ void IntegralHistogram::build(const cv::Mat& img) {
+     begin(img.rows, img.cols);
+     addRows(img, 0);
+     finish();
+ }
+ 
+ void IntegralHistogram::begin(int rows, int cols) {
+     imageRows = rows;
+     imageCols = cols;
+     gridRows = std::min(resolution, std::max(1, rows));
+     gridCols = std::min(resolution, std::max(1, cols));
+     table.assign((size_t)(gridRows + 1) * (gridCols + 1) * HISTOGRAM_SIZE, 0);
+ }
+ 
+ void IntegralHistogram::addRows(const cv::Mat& band, int firstRow) {
+     // Until finish(), entry (gy + 1, gx + 1) holds the plain counts of cell (gy, gx).
+     for (int gy = 0; gy < gridRows; gy++) {
+         int r0 = std::max(firstRow, gy * imageRows / gridRows);
+         int r1 = std::min(firstRow + band.rows, (gy + 1) * imageRows / gridRows);
+         if (r0 >= r1) continue;
+         for (int gx = 0; gx < gridCols; gx++) {
+             int c0 = gx * imageCols / gridCols, c1 = (gx + 1) * imageCols / gridCols;
+             unsigned counts[3][HISTOGRAM_BINS] = {};
+             countBlock(band, r0 - firstRow, r1 - firstRow, c0, c1, counts);
+             unsigned* s = cell(gy + 1, gx + 1);
+             for (int ch = 0; ch < 3; ch++) {
+                 for (int b = 0; b < HISTOGRAM_BINS; b++) s[ch * HISTOGRAM_BINS + b] += counts[ch][b];
+             }
+         }
+     }
+ }
+ 
+ void IntegralHistogram::finish() {
+     // Turn the cell counts into running sums, in row-major order:
+     // S(y, x) = cell(y-1, x-1) + S(y-1, x) + S(y, x-1) - S(y-1, x-1).
+     for (int gy = 1; gy <= gridRows; gy++) {
+         for (int gx = 1; gx <= gridCols; gx++) {
+             unsigned* s = cell(gy, gx);
+             const unsigned* up = cell(gy - 1, gx);
+             const unsigned* left = cell(gy, gx - 1);
+             const unsigned* diag = cell(gy - 1, gx - 1);
+             for (int k = 0; k < HISTOGRAM_SIZE; k++) s[k] += up[k] + left[k] - diag[k];
+         }
+     }
+ }
+ 
+ void IntegralHistogram::regionHistogram(const cv::Rect& region, float* out) const {
+     // Snap the rectangle to the nearest cell boundaries, keeping at least one cell.
+     auto snap = [](int pixel, int pixels, int cells) {
+         int g = pixels > 0 ? (int)std::lround((double)pixel * cells / pixels) : 0;
+         return std::max(0, std::min(cells, g));
+     };
+     int y0 = snap(region.y, imageRows, gridRows), y1 = snap(region.y + region.height, imageRows, gridRows);
+     int x0 = snap(region.x, imageCols, gridCols), x1 = snap(region.x + region.width, imageCols, gridCols);
+     if (y1 <= y0) { y1 = std::min(gridRows, y0 + 1); y0 = y1 - 1; }
+     if (x1 <= x0) { x1 = std::min(gridCols, x0 + 1); x0 = x1 - 1; }
+ 
+     // Four lookups per bin, independent of the size of the region.
+     const unsigned* a = cell(y1, x1);
+     const unsigned* b = cell(y0, x1);
+     const unsigned* c = cell(y1, x0);
+     const unsigned* d = cell(y0, x0);
+     unsigned counts[3][HISTOGRAM_BINS];
+     for (int ch = 0; ch < 3; ch++) {
+         for (int i = 0; i < HISTOGRAM_BINS; i++) {
+             int k = ch * HISTOGRAM_BINS + i;
+             counts[ch][i] = a[k] - b[k] - c[k] + d[k];
+         }
+     }
+     normalizeHistogram(counts, out);
+ }
+ 
+ void IntegralHistogram::histogram(float* out) const {
+     regionHistogram(cv::Rect(0, 0, imageCols, imageRows), out);
+ }
+ 
+ //=============================================================================
+ // Perceptual Hash (dHash)
+ //=============================================================================
+ 
+ /**
+  * @brief Computes a 64-bit difference hash (dHash) of a decoded image.
+  *
+  * Each grid cell averages the luminance (0.114 B + 0.587 G + 0.299 R) of its block
+  * of pixels, read directly from the image so no resized copy is allocated. For
+  * images smaller than the grid, a cell falls back to a single pixel.
+  */
+ uint64_t computeDHash(const cv::Mat& img) {
+     DHashBuilder builder;
+     builder.begin(img.rows, img.cols);
+     builder.addRows(img, 0);
+     return builder.finish();
+ }
+ 
+ void DHashBuilder::begin(int rows, int cols) {
+     imageRows = rows;
+     imageCols = cols;
+     for (auto& row : sums) std::fill(std::begin(row), std::end(row), 0);
+ }
+ 
+ void DHashBuilder::addRows(const cv::Mat& band, int firstRow) {
+     for (int gy = 0; gy < GRID_ROWS; gy++) {
+         int cellBegin = gy * imageRows / GRID_ROWS;
+         int cellEnd = std::max(cellBegin + 1, (gy + 1) * imageRows / GRID_ROWS);
+         int r0 = std::max(firstRow, cellBegin), r1 = std::min(firstRow + band.rows, cellEnd);
+         for (int r = r0; r < r1; r++) {
+             const unsigned char* row = band.ptr<unsigned char>(r - firstRow);
+             for (int gx = 0; gx < GRID_COLS; gx++) {
+                 int c0 = gx * imageCols / GRID_COLS;
+                 int c1 = std::max(c0 + 1, (gx + 1) * imageCols / GRID_COLS);
+                 const unsigned char* px = row + c0 * 3;
+                 uint64_t sum = 0;
+                 for (int c = c0; c < c1; c++, px += 3) {
+                     sum += 114u * px[0] + 587u * px[1] + 299u * px[2];
+                 }
+                 sums[gy][gx] += sum;
+             }
+         }
+     }
+ }
+ 
+ uint64_t DHashBuilder::finish() const {
+     double cell[GRID_ROWS][GRID_COLS];
+     for (int gy = 0; gy < GRID_ROWS; gy++) {
+         int r0 = gy * imageRows / GRID_ROWS;
+         int r1 = std::max(r0 + 1, (gy + 1) * imageRows / GRID_ROWS);
+         for (int gx = 0; gx < GRID_COLS; gx++) {
+             int c0 = gx * imageCols / GRID_COLS;
+             int c1 = std::max(c0 + 1, (gx + 1) * imageCols / GRID_COLS);
+             cell[gy][gx] = (double)sums[gy][gx] / ((r1 - r0) * (c1 - c0));
+         }
+     }
+ 
+     uint64_t hash = 0;
+     for (int gy = 0; gy < GRID_ROWS; gy++) {
+         for (int gx = 0; gx < GRID_COLS - 1; gx++) {
+             if (cell[gy][gx] < cell[gy][gx + 1]) hash |= 1ULL << (gy * 8 + gx);
+         }
+     }
+     return hash;
+ }
+ 
+ //=============================================================================
+ // HistogramExtractor Implementation
+ //=============================================================================
+ 
+ bool HistogramExtractor::extract(const unsigned char* data, size_t size, float* out, uint64_t* perceptualHash,
+                                  IntegralHistogram* integral) {
+     // imdecode asserts on an empty buffer, and that would end a worker thread.
+     if (size == 0) return false;
+     // Wrap the caller's bytes without copying them; imdecode reuses 'decoded'
+     // when the new image has the same size and type as the previous one. On
+     // failure it leaves 'decoded' holding the previous image, so the returned
+     // Mat, not 'decoded', says whether this call succeeded.
+     cv::Mat encoded(1, (int)size, CV_8UC1, const_cast<unsigned char*>(data));
+     try {
+         if (cv::imdecode(encoded, cv::IMREAD_COLOR, &decoded).empty()) return false;
+     } catch (const cv::Exception&) {
+         return false;
+     }
+     if (integral != nullptr) {
+         // The whole-image histogram falls out of the integral table for free.
+         integral->build(decoded);
+         integral->histogram(out);
+     } else {
+         computeHistogram(decoded, out);
+     }
+     if (perceptualHash != nullptr) *perceptualHash = computeDHash(decoded);
+     return true;
+ }
+ 
+ bool HistogramExtractor::readFile(const std::string& path) {
+     // Plain POSIX I/O, since opening a stream would allocate its own buffer.
+     int fd = open(path.c_str(), O_RDONLY);
+     struct stat st;
+     if (fd < 0 || fstat(fd, &st) != 0) {
+         if (fd >= 0) close(fd);
+         std::cerr << "Error: Could not open or find the image at: " << path << std::endl;
+         return false;
+     }
+     size_t size = (size_t)st.st_size;
+     if (fileBuffer.size() < size) fileBuffer.resize(size);
+     size_t done = 0;
+     while (done < size) {
+         ssize_t got = read(fd, fileBuffer.data() + done, size - done);
+         if (got <= 0) break;
+         done += (size_t)got;
+     }
+     close(fd);
+ 
+     if (done != size) {
+         std::cerr << "Error: Could not read the image at: " << path << std::endl;
+         return false;
+     }
+     fileSize = size;
+     fileHash = contentHash(fileBuffer.data(), fileSize);
+     return true;
+ }
+ 
+ bool HistogramExtractor::extractFile(const std::string& path, float* out, uint64_t* perceptualHash) {
+     if (!readFile(path)) return false;
+     if (!extract(fileBuffer.data(), fileSize, out, perceptualHash)) {
+         std::cerr << "Error: Could not decode the image at: " << path << std::endl;
+         return false;
+     }
+     return true;
+ }
+ 
+ //=============================================================================
+ // Content Hashing
+ //=============================================================================
+ 
+ namespace {
+ 
+ const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+ const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+ const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+ const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+ const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+ 
+ inline uint64_t rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+ 
+ // Little-endian reads (the target platforms are all little-endian).
+ inline uint64_t read64(const unsigned char* p) { uint64_t v; std::memcpy(&v, p, 8); return v; }
+ inline uint32_t read32(const unsigned char* p) { uint32_t v; std::memcpy(&v, p, 4); return v; }
+ 
+ inline uint64_t xxhRound(uint64_t acc, uint64_t input) {
+     acc += input * PRIME64_2;
+     return rotl64(acc, 31) * PRIME64_1;
+ }
+ 
+ inline uint64_t xxhMerge(uint64_t acc, uint64_t val) {
+     acc ^= xxhRound(0, val);
+     return acc * PRIME64_1 + PRIME64_4;
+ }
+ 
+ } // namespace
+ 
+ /**
+  * @brief Computes a fast 64-bit content hash (XXH64) of a byte range.
+  *
+  * This is the reference XXH64 algorithm: four independent accumulators consume
+  * 32-byte stripes, then the tail is mixed in and the result avalanched.
+  */
+ uint64_t contentHash(const unsigned char* data, size_t size, uint64_t seed) {
+     const unsigned char* p = data;
+     const unsigned char* end = data + size;
+     uint64_t h;
+ 
+     if (size >= 32) {
+         uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+         uint64_t v2 = seed + PRIME64_2;
+         uint64_t v3 = seed;
+         uint64_t v4 = seed - PRIME64_1;
+         for (; p + 32 <= end; p += 32) {
+             v1 = xxhRound(v1, read64(p));
+             v2 = xxhRound(v2, read64(p + 8));
+             v3 = xxhRound(v3, read64(p + 16));
+             v4 = xxhRound(v4, read64(p + 24));
+         }
+         h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+         h = xxhMerge(h, v1);
+         h = xxhMerge(h, v2);
+         h = xxhMerge(h, v3);
+         h = xxhMerge(h, v4);
+     } else {
+         h = seed + PRIME64_5;
+     }
+     h += (uint64_t)size;
+ 
+     for (; p + 8 <= end; p += 8) {
+         h ^= xxhRound(0, read64(p));
+         h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+     }
+     if (p + 4 <= end) {
+         h ^= (uint64_t)read32(p) * PRIME64_1;
+         h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+         p += 4;
+     }
+     for (; p < end; ++p) {
+         h ^= (*p) * PRIME64_5;
+         h = rotl64(h, 11) * PRIME64_1;
+     }
+ 
+     h ^= h >> 33;
+     h *= PRIME64_2;
+     h ^= h >> 29;
+     h *= PRIME64_3;
+     h ^= h >> 32;
+     return h;
+ }
+ 
+ size_t ContentHashMap::findOrInsert(uint64_t hash, uint64_t size, size_t row) {
+     std::lock_guard<std::mutex> guard(lock);
+     auto it = entries.find(hash);
+     if (it == entries.end()) {
+         entries.emplace(hash, Entry{size, row});
+         return row;
+     }
+     // A different size means a (very unlikely) hash collision: keep the file separate.
+     return it->second.size == size ? it->second.row : row;
+ }
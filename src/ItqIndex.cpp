@@ -0,0 +1,283 @@
+/**
+ * @file ItqIndex.cpp
+ * @brief Implements ITQ training (PCA + orthogonal Procrustes) and the Hamming-scan search.
+ */
+
+ #include "ItqIndex.h"
+ #include <algorithm> // for std::min, std::sort
+ #include <cmath>
+ #include <cstring>
+ #include <iostream>
+ #include <numeric>   // for std::iota
+ #include <random>
+
+ namespace {
+
+ // Eigen-decomposition of a symmetric n x n matrix (row-major) by cyclic Jacobi
+ // rotations. The eigenvalues are returned in decreasing order; column i of
+ // vectors is the eigenvector of values[i]. The matrices here are at most 64 x 64.
+ void symmetricEigen(std::vector<double> a, int n, std::vector<double>& values, std::vector<double>& vectors) {
+     std::vector<double> v((size_t)n * n, 0.0);
+     for (int i = 0; i < n; i++) v[i * n + i] = 1.0;
+
+     for (int sweep = 0; sweep < 100; sweep++) {
+         double off = 0.0;
+         for (int p = 0; p < n; p++) {
+             for (int q = p + 1; q < n; q++) off += a[p * n + q] * a[p * n + q];
+         }
+         if (off < 1e-22) break;
+
+         for (int p = 0; p < n; p++) {
+             for (int q = p + 1; q < n; q++) {
+                 double apq = a[p * n + q];
+                 if (std::abs(apq) < 1e-300) continue;
+                 // Rotation angle that zeroes a(p, q).
+                 double theta = (a[q * n + q] - a[p * n + p]) / (2.0 * apq);
+                 double t = (theta >= 0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+                 double c = 1.0 / std::sqrt(t * t + 1.0), s = t * c;
+                 for (int k = 0; k < n; k++) { // A := A J
+                     double akp = a[k * n + p], akq = a[k * n + q];
+                     a[k * n + p] = c * akp - s * akq;
+                     a[k * n + q] = s * akp + c * akq;
+                 }
+                 for (int k = 0; k < n; k++) { // A := J^T A
+                     double apk = a[p * n + k], aqk = a[q * n + k];
+                     a[p * n + k] = c * apk - s * aqk;
+                     a[q * n + k] = s * apk + c * aqk;
+                 }
+                 for (int k = 0; k < n; k++) { // V := V J
+                     double vkp = v[k * n + p], vkq = v[k * n + q];
+                     v[k * n + p] = c * vkp - s * vkq;
+                     v[k * n + q] = s * vkp + c * vkq;
+                 }
+             }
+         }
+     }
+
+     std::vector<int> order(n);
+     std::iota(order.begin(), order.end(), 0);
+     std::sort(order.begin(), order.end(), [&](int x, int y) { return a[x * n + x] > a[y * n + y]; });
+     values.assign(n, 0.0);
+     vectors.assign((size_t)n * n, 0.0);
+     for (int i = 0; i < n; i++) {
+         values[i] = a[order[i] * n + order[i]];
+         for (int k = 0; k < n; k++) vectors[k * n + i] = v[k * n + order[i]];
+     }
+ }
+
+ } // namespace
+
+ ItqIndex::ItqIndex(int dimensions, int nBits, int nIterations, unsigned randomSeed)
+     : dims(dimensions), numBits(std::max(1, std::min({nBits, dimensions, 64}))),
+       iterations(nIterations), seed(randomSeed) {
+     codes.resize(8, 0);
+ }
+
+ //=============================================================================
+ // Training
+ //=============================================================================
+
+ bool ItqIndex::train(const std::vector<Document>& sample) {
+     size_t n = sample.size();
+     if (n < 2) {
+         std::cerr << "Error: ITQ needs at least two training documents." << std::endl;
+         return false;
+     }
+     int c = numBits;
+
+     // Center the data and compute its covariance.
+     std::vector<double> mu(dims, 0.0);
+     for (const auto& d : sample) {
+         for (int j = 0; j < dims; j++) mu[j] += d.features[j];
+     }
+     for (auto& m : mu) m /= n;
+     std::vector<double> cov((size_t)dims * dims, 0.0);
+     std::vector<double> x(dims);
+     for (const auto& d : sample) {
+         for (int j = 0; j < dims; j++) x[j] = d.features[j] - mu[j];
+         for (int i = 0; i < dims; i++) {
+             for (int j = i; j < dims; j++) cov[i * dims + j] += x[i] * x[j];
+         }
+     }
+     for (int i = 0; i < dims; i++) {
+         for (int j = i; j < dims; j++) cov[j * dims + i] = cov[i * dims + j] /= n;
+     }
+
+     // W: the top c principal directions (dims x c).
+     std::vector<double> values, vectors;
+     symmetricEigen(cov, dims, values, vectors);
+     std::vector<double> w((size_t)dims * c);
+     for (int k = 0; k < dims; k++) {
+         for (int i = 0; i < c; i++) w[k * c + i] = vectors[k * dims + i];
+     }
+
+     // V = centered data projected onto W (n x c).
+     std::vector<double> v(n * c, 0.0);
+     for (size_t r = 0; r < n; r++) {
+         for (int k = 0; k < dims; k++) {
+             double xk = sample[r].features[k] - mu[k];
+             for (int i = 0; i < c; i++) v[r * c + i] += xk * w[k * c + i];
+         }
+     }
+
+     // Random orthogonal initial rotation R (c x c): Gram-Schmidt on a Gaussian matrix.
+     std::mt19937 gen(seed);
+     std::normal_distribution<double> gauss(0.0, 1.0);
+     std::vector<double> rot((size_t)c * c);
+     for (auto& e : rot) e = gauss(gen);
+     for (int i = 0; i < c; i++) {
+         for (int j = 0; j < i; j++) {
+             double dot = 0.0;
+             for (int k = 0; k < c; k++) dot += rot[k * c + i] * rot[k * c + j];
+             for (int k = 0; k < c; k++) rot[k * c + i] -= dot * rot[k * c + j];
+         }
+         double norm = 0.0;
+         for (int k = 0; k < c; k++) norm += rot[k * c + i] * rot[k * c + i];
+         norm = std::sqrt(norm);
+         for (int k = 0; k < c; k++) rot[k * c + i] /= norm;
+     }
+
+     // Alternate B = sign(V R) and the orthogonal Procrustes update
+     // R = polar factor of M = V^T B, i.e. M (M^T M)^(-1/2).
+     std::vector<double> m((size_t)c * c), mtm((size_t)c * c), proj(c);
+     for (int it = 0; it < iterations; it++) {
+         std::fill(m.begin(), m.end(), 0.0);
+         for (size_t r = 0; r < n; r++) {
+             const double* vr = &v[r * c];
+             for (int j = 0; j < c; j++) {
+                 double p = 0.0;
+                 for (int k = 0; k < c; k++) p += vr[k] * rot[k * c + j];
+                 proj[j] = p >= 0.0 ? 1.0 : -1.0;
+             }
+             for (int i = 0; i < c; i++) {
+                 for (int j = 0; j < c; j++) m[i * c + j] += vr[i] * proj[j];
+             }
+         }
+         for (int i = 0; i < c; i++) {
+             for (int j = 0; j < c; j++) {
+                 double s = 0.0;
+                 for (int k = 0; k < c; k++) s += m[k * c + i] * m[k * c + j];
+                 mtm[i * c + j] = s;
+             }
+         }
+         std::vector<double> lambda, q;
+         symmetricEigen(mtm, c, lambda, q);
+         if (lambda[c - 1] <= 1e-12 * lambda[0]) break; // Degenerate data; keep the current rotation.
+
+         // (M^T M)^(-1/2) = Q diag(1 / sqrt(lambda)) Q^T
+         std::vector<double> invRoot((size_t)c * c, 0.0);
+         for (int i = 0; i < c; i++) {
+             for (int j = 0; j < c; j++) {
+                 double s = 0.0;
+                 for (int k = 0; k < c; k++) s += q[i * c + k] * q[j * c + k] / std::sqrt(lambda[k]);
+                 invRoot[i * c + j] = s;
+             }
+         }
+         for (int i = 0; i < c; i++) {
+             for (int j = 0; j < c; j++) {
+                 double s = 0.0;
+                 for (int k = 0; k < c; k++) s += m[i * c + k] * invRoot[k * c + j];
+                 rot[i * c + j] = s;
+             }
+         }
+     }
+
+     // Fold W R into one projection: bit j is the sign of (x - mean) . projection[j].
+     mean.assign(mu.begin(), mu.end());
+     projection.assign((size_t)c * dims, 0.0f);
+     for (int j = 0; j < c; j++) {
+         for (int k = 0; k < dims; k++) {
+             double s = 0.0;
+             for (int i = 0; i < c; i++) s += w[k * c + i] * rot[i * c + j];
+             projection[j * dims + k] = (float)s;
+         }
+     }
+     trained = true;
+     docs.clear();
+     codes.assign(8, 0);
+     multiIndex.reset();
+     return true;
+ }
+
+ //=============================================================================
+ // Encoding and Search
+ //=============================================================================
+
+ uint64_t ItqIndex::encode(const std::vector<float>& features) const {
+     uint64_t code = 0;
+     for (int j = 0; j < numBits; j++) {
+         const float* p = &projection[j * dims];
+         float dot = 0.0f;
+         for (int k = 0; k < dims; k++) dot += (features[k] - mean[k]) * p[k];
+         if (dot >= 0.0f) code |= 1ULL << j;
+     }
+     return code;
+ }
+
+ uint64_t ItqIndex::loadCode(size_t index) const {
+     // Codes are little-endian and the buffer is padded, so an 8-byte load is always in bounds.
+     uint64_t code;
+     std::memcpy(&code, &codes[index * codeBytes()], sizeof(code));
+     return numBits == 64 ? code : code & ((1ULL << numBits) - 1);
+ }
+
+ void ItqIndex::insert(const Document& d) {
+     if (!trained) {
+         std::cerr << "Error: ItqIndex::insert called before train()." << std::endl;
+         return;
+     }
+     uint64_t code = encode(d.features);
+     size_t offset = docs.size() * codeBytes();
+     codes.resize(offset + codeBytes() + 8, 0);
+     std::memcpy(&codes[offset], &code, codeBytes());
+     docs.push_back(d);
+     if (multiIndex) multiIndex->insert(code);
+ }
+
+ void ItqIndex::useMultiIndex(int substrings) {
+     if (substrings <= 0) substrings = MultiIndexHash::recommendedSubstrings(numBits, docs.size());
+     multiIndex.reset(new MultiIndexHash(numBits, substrings));
+     for (size_t i = 0; i < docs.size(); i++) multiIndex->insert(loadCode(i));
+ }
+
+ std::vector<Document> ItqIndex::searchSimilar(const Document& query, int k, int rerank) const {
+     if (docs.empty() || k <= 0) return {};
+     size_t candidates = std::min(docs.size(), (size_t)(rerank < 0 ? 10 * k : std::max(rerank, k)));
+     uint64_t q = encode(query.features);
+
+     std::vector<DocDist> ranked;
+     ranked.reserve(candidates);
+     if (multiIndex) {
+         for (uint32_t id : multiIndex->nearest(q, (int)candidates)) {
+             ranked.push_back({docs[id], euclideanDistance(query.features, docs[id].features)});
+         }
+     } else {
+         scanCandidates(q, candidates, query, ranked);
+     }
+     std::sort(ranked.begin(), ranked.end(), [](const DocDist& a, const DocDist& b) { return a.dist < b.dist; });
+
+     std::vector<Document> results;
+     for (size_t i = 0; i < ranked.size() && (int)i < k; i++) results.push_back(ranked[i].doc);
+     return results;
+ }
+
+ void ItqIndex::scanCandidates(uint64_t q, size_t candidates, const Document& query, std::vector<DocDist>& ranked) const {
+     // One popcount per document, then a counting pass over the possible distances
+     // finds the Hamming radius that holds the candidates, without sorting.
+     std::vector<uint8_t> distance(docs.size());
+     std::vector<size_t> histogram(numBits + 1, 0);
+     for (size_t i = 0; i < docs.size(); i++) {
+         distance[i] = (uint8_t)__builtin_popcountll(loadCode(i) ^ q);
+         histogram[distance[i]]++;
+     }
+     int radius = 0;
+     for (size_t covered = histogram[0]; covered < candidates; covered += histogram[++radius]) {}
+     size_t atRadius = candidates;
+     for (int r = 0; r < radius; r++) atRadius -= histogram[r];
+
+     for (size_t i = 0; i < docs.size(); i++) {
+         if (distance[i] > radius || (distance[i] == radius && atRadius == 0)) continue;
+         if (distance[i] == radius) atRadius--;
+         ranked.push_back({docs[i], euclideanDistance(query.features, docs[i].features)});
+     }
+ }
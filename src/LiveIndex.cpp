@@ -0,0 +1,84 @@
+/**
+ * @file LiveIndex.cpp
+ * @brief Implements the incrementally updated index used by the watch mode.
+ */
+
+ #include "LiveIndex.h"
+ #include <algorithm> // for std::sort
+ #include <mutex>
+
+ namespace {
+
+ // Same LSH configuration as the experiments in main.cpp.
+ const int LIVE_LSH_HASHES = 16;
+ const float LIVE_LSH_WIDTH = 0.5f;
+
+ } // namespace
+
+ LiveIndex::LiveIndex(int dimensions, int firstId, unsigned seed)
+     : dims(dimensions), nextId(firstId), tree(new KdTree(dimensions)),
+       lsh(dimensions, LIVE_LSH_HASHES, LIVE_LSH_WIDTH, HashFamily::GaussianProjection, seed) {}
+
+ void LiveIndex::removeLocked(const Document& d) {
+     tree->remove(d);
+     lsh.remove(d);
+
+     // Compact once tombstones dominate, so searches do not wade through dead nodes.
+     if (tree->removedCount() > tree->size()) {
+         std::vector<const Document*> live;
+         live.reserve(byPath.size());
+         for (const auto& entry : byPath) {
+             if (entry.second.id != d.id) live.push_back(&entry.second);
+         }
+         // Insert in id order so the rebuilt tree does not depend on hash map order.
+         std::sort(live.begin(), live.end(), [](const Document* a, const Document* b) { return a->id < b->id; });
+         tree.reset(new KdTree(dims));
+         for (const Document* doc : live) tree->insert(*doc);
+     }
+ }
+
+ int LiveIndex::insertOrReplace(const std::string& path, const std::vector<float>& features) {
+     std::unique_lock<std::shared_mutex> lock(mutex);
+     auto it = byPath.find(path);
+     int id;
+     if (it != byPath.end()) {
+         id = it->second.id;
+         removeLocked(it->second);
+         it->second.features = features;
+     } else {
+         id = nextId++;
+         it = byPath.emplace(path, Document(id, features, path)).first;
+     }
+     tree->insert(it->second);
+     lsh.insert(it->second);
+     return id;
+ }
+
+ bool LiveIndex::remove(const std::string& path) {
+     std::unique_lock<std::shared_mutex> lock(mutex);
+     auto it = byPath.find(path);
+     if (it == byPath.end()) return false;
+     removeLocked(it->second);
+     byPath.erase(it);
+     return true;
+ }
+
+ bool LiveIndex::contains(const std::string& path) const {
+     std::shared_lock<std::shared_mutex> lock(mutex);
+     return byPath.count(path) != 0;
+ }
+
+ size_t LiveIndex::size() const {
+     std::shared_lock<std::shared_mutex> lock(mutex);
+     return byPath.size();
+ }
+
+ std::vector<Document> LiveIndex::searchSimilar(const Document& query, int k) const {
+     std::shared_lock<std::shared_mutex> lock(mutex);
+     return tree->searchSimilar(query, k);
+ }
+
+ std::vector<Document> LiveIndex::searchApproximate(const Document& query, int k) const {
+     std::shared_lock<std::shared_mutex> lock(mutex);
+     return lsh.searchSimilar(query, k);
+ }
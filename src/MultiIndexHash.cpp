@@ -0,0 +1,152 @@
+/**
+ * @file MultiIndexHash.cpp
+ * @brief Implements the substring tables and the exact r-neighbour and k-NN probes.
+ */
+
+ #include "MultiIndexHash.h"
+ #include <algorithm> // for std::max, std::min
+ #include <cmath>
+
+ MultiIndexHash::MultiIndexHash(int bits, int substrings) : numBits(std::max(1, std::min(bits, 64))) {
+     numTables = std::max({1, std::min(substrings, numBits), (numBits + 31) / 32});
+     // The first numBits % m substrings get one extra bit.
+     for (int t = 0, offset = 0; t < numTables; t++) {
+         int width = numBits / numTables + (t < numBits % numTables ? 1 : 0);
+         offsets.push_back(offset);
+         widths.push_back(width);
+         offset += width;
+     }
+     tables.resize(numTables);
+ }
+
+ int MultiIndexHash::recommendedSubstrings(int bits, size_t n) {
+     double logN = std::log2((double)std::max<size_t>(n, 2));
+     return std::max(1, (int)std::lround(bits / logN));
+ }
+
+ // Number of substrings one table must probe at the given radius: C(width, radius).
+ double MultiIndexHash::probeCount(int radius) const {
+     double total = 0.0;
+     for (int width : widths) {
+         if (radius > width) continue;
+         double c = 1.0;
+         for (int i = 0; i < radius; i++) c = c * (width - i) / (i + 1);
+         total += c;
+     }
+     return total;
+ }
+
+ uint64_t MultiIndexHash::substring(uint64_t code, int table) const {
+     return (code >> offsets[table]) & ((1ULL << widths[table]) - 1);
+ }
+
+ void MultiIndexHash::insert(uint64_t code) {
+     uint32_t id = (uint32_t)codes.size();
+     codes.push_back(code);
+     for (int t = 0; t < numTables; t++) tables[t][substring(code, t)].push_back(id);
+ }
+
+ //=============================================================================
+ // Probing
+ //=============================================================================
+
+ // Probes visit (radius, table) pairs in lexicographic order, so a code is first met
+ // at the smallest (substring distance, table). Checking that here deduplicates the
+ // candidates of all tables without a per-query visited set.
+ bool MultiIndexHash::firstSeenAt(uint64_t query, uint64_t code, int table, int radius) const {
+     for (int t = 0; t < numTables; t++) {
+         if (t == table) continue;
+         int d = __builtin_popcountll(substring(query ^ code, t));
+         if (d < radius || (d == radius && t < table)) return false;
+     }
+     return true;
+ }
+
+ void MultiIndexHash::probe(uint64_t query, int table, int radius, std::vector<uint32_t>& hits) const {
+     int width = widths[table];
+     if (radius > width) return;
+     uint64_t key = substring(query, table);
+     uint64_t limit = 1ULL << width;
+     // Enumerate every width-bit mask with exactly radius bits set (Gosper's hack).
+     for (uint64_t flip = (1ULL << radius) - 1; flip < limit;) {
+         auto bucket = tables[table].find(key ^ flip);
+         if (bucket != tables[table].end()) {
+             for (uint32_t id : bucket->second) {
+                 if (firstSeenAt(query, codes[id], table, radius)) hits.push_back(id);
+             }
+         }
+         if (flip == 0) break;
+         uint64_t low = flip & (~flip + 1);
+         uint64_t ripple = flip + low;
+         flip = (((ripple ^ flip) >> 2) / low) | ripple;
+     }
+ }
+
+ //=============================================================================
+ // Queries
+ //=============================================================================
+
+ std::vector<uint32_t> MultiIndexHash::rangeSearch(uint64_t query, int radius) const {
+     std::vector<uint32_t> hits, results;
+     // Pigeonhole: an r-neighbour is within floor(r / m) bits on some substring.
+     int substringRadius = std::max(0, radius) / numTables;
+     double probes = 0.0;
+     for (int r = 0; r <= substringRadius; r++) probes += probeCount(r);
+     if (probes > (double)codes.size()) {
+         // Enumerating the substrings would cost more than checking every code.
+         for (uint32_t id = 0; id < codes.size(); id++) {
+             if (__builtin_popcountll(codes[id] ^ query) <= radius) results.push_back(id);
+         }
+         return results;
+     }
+     for (int r = 0; r <= substringRadius; r++) {
+         for (int t = 0; t < numTables; t++) {
+             hits.clear();
+             probe(query, t, r, hits);
+             for (uint32_t id : hits) {
+                 if (__builtin_popcountll(codes[id] ^ query) <= radius) results.push_back(id);
+             }
+         }
+     }
+     return results;
+ }
+
+ std::vector<uint32_t> MultiIndexHash::nearest(uint64_t query, int k) const {
+     std::vector<uint32_t> results;
+     if (k <= 0 || codes.empty()) return results;
+     size_t wanted = std::min(codes.size(), (size_t)k);
+
+     // Candidates bucketed by their full Hamming distance.
+     std::vector<std::vector<uint32_t>> byDistance(numBits + 1);
+     std::vector<uint32_t> hits;
+     int maxWidth = *std::max_element(widths.begin(), widths.end());
+     for (int r = 0; r <= maxWidth; r++) {
+         if (probeCount(r) > (double)codes.size()) {
+             // The next radius would probe more substrings than there are codes: finish
+             // with a scan, bucketing every code by distance instead.
+             for (auto& bucket : byDistance) bucket.clear();
+             for (uint32_t id = 0; id < codes.size(); id++) byDistance[__builtin_popcountll(codes[id] ^ query)].push_back(id);
+             for (int d = 0; d <= numBits && results.size() < wanted; d++) {
+                 for (size_t i = 0; i < byDistance[d].size() && results.size() < wanted; i++) results.push_back(byDistance[d][i]);
+             }
+             return results;
+         }
+         for (int t = 0; t < numTables; t++) {
+             hits.clear();
+             probe(query, t, r, hits);
+             for (uint32_t id : hits) byDistance[__builtin_popcountll(codes[id] ^ query)].push_back(id);
+
+             // Everything within r * m + t bits has now been seen.
+             int bound = std::min(numBits, r * numTables + t);
+             size_t covered = 0;
+             for (int d = 0; d <= bound; d++) covered += byDistance[d].size();
+             if (covered >= wanted) {
+                 for (int d = 0; d <= bound && results.size() < wanted; d++) {
+                     for (size_t i = 0; i < byDistance[d].size() && results.size() < wanted; i++) results.push_back(byDistance[d][i]);
+                 }
+                 return results;
+             }
+         }
+     }
+     return results; // Unreachable: the last probe covers every code.
+ }
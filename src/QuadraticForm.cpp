@@ -0,0 +1,64 @@
+/**
+ * @file QuadraticForm.cpp
+ * @brief Implements the Cholesky-based quadratic-form feature transform.
+ */
+
+ #include "QuadraticForm.h"
+ #include "ImageUtils.h" // for HISTOGRAM_BINS, HISTOGRAM_SIZE
+ #include <algorithm> // for std::max
+ #include <cmath>
+
+ std::vector<double> QuadraticFormTransform::binSimilarity(double sigma) {
+     std::vector<double> a(HISTOGRAM_SIZE * HISTOGRAM_SIZE, 0.0);
+     // Feature index i * 3 + ch holds bin i of channel ch.
+     for (int ch = 0; ch < 3; ch++) {
+         for (int i = 0; i < HISTOGRAM_BINS; i++) {
+             for (int j = 0; j < HISTOGRAM_BINS; j++) {
+                 double d = i - j;
+                 a[(i * 3 + ch) * HISTOGRAM_SIZE + (j * 3 + ch)] = std::exp(-d * d / (2.0 * sigma * sigma));
+             }
+         }
+     }
+     return a;
+ }
+
+ bool QuadraticFormTransform::factorize(const std::vector<double>& matrix, int dimensions) {
+     if (dimensions <= 0 || matrix.size() != (size_t)dimensions * dimensions) return false;
+     std::vector<double> l((size_t)dimensions * dimensions, 0.0);
+     for (int j = 0; j < dimensions; j++) {
+         double diag = matrix[j * dimensions + j];
+         for (int k = 0; k < j; k++) diag -= l[j * dimensions + k] * l[j * dimensions + k];
+         if (diag <= 0.0) {
+             std::cerr << "Error: The similarity matrix is not positive definite." << std::endl;
+             return false;
+         }
+         l[j * dimensions + j] = std::sqrt(diag);
+         for (int i = j + 1; i < dimensions; i++) {
+             double sum = matrix[i * dimensions + j];
+             for (int k = 0; k < j; k++) sum -= l[i * dimensions + k] * l[j * dimensions + k];
+             l[i * dimensions + j] = sum / l[j * dimensions + j];
+         }
+     }
+     dims = dimensions;
+     similarity = matrix;
+     factor = std::move(l);
+     return true;
+ }
+
+ void QuadraticFormTransform::apply(const float* x, float* out) const {
+     // (L^T x)_j = sum over i >= j of L(i, j) * x_i.
+     for (int j = 0; j < dims; j++) {
+         double sum = 0.0;
+         for (int i = j; i < dims; i++) sum += factor[i * dims + j] * x[i];
+         out[j] = (float)sum;
+     }
+ }
+
+ double QuadraticFormTransform::distance(const float* x, const float* y) const {
+     double sum = 0.0;
+     for (int i = 0; i < dims; i++) {
+         double di = (double)x[i] - y[i];
+         for (int j = 0; j < dims; j++) sum += di * similarity[i * dims + j] * ((double)x[j] - y[j]);
+     }
+     return std::sqrt(std::max(0.0, sum));
+ }
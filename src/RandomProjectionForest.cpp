@@ -0,0 +1,429 @@
+/**
+ * @file RandomProjectionForest.cpp
+ * @brief Implements the random projection forest and its flat, mappable image.
+ */
+
+ #include "RandomProjectionForest.h"
+ #include <algorithm> // for std::partition, std::sort, std::unique
+ #include <atomic>
+ #include <cstring>
+ #include <fstream>
+ #include <queue>
+ #include <random>
+ #include <thread>
+
+ #include <fcntl.h>
+ #include <sys/mman.h>
+ #include <sys/stat.h>
+ #include <unistd.h>
+
+ namespace {
+
+ const char RP_FOREST_MAGIC[4] = {'R', 'P', 'F', 'T'};
+ const uint32_t RP_FOREST_VERSION = 1;
+ const size_t SECTION_ALIGNMENT = 64; // Keep every section on its own cache line.
+
+ // Header at the start of the image. Sections are addressed by byte offsets
+ // from the start of the image, so the image can be mapped at any address.
+ struct RPForestHeader {
+     char magic[4];
+     uint32_t version;
+     uint32_t dims;
+     uint32_t numDocs;
+     uint32_t numTrees;
+     uint32_t numNodes;
+     uint32_t numNormals;
+     uint32_t numLeafItems;
+     uint64_t rootsOffset;
+     uint64_t nodesOffset;
+     uint64_t normalsOffset;
+     uint64_t leafItemsOffset;
+     uint64_t featuresOffset;
+     uint64_t idsOffset;
+     uint64_t nameOffsetsOffset;
+     uint64_t namesOffset;
+     uint64_t imageSize;
+ };
+
+ // A single tree under construction, with tree-local indices.
+ struct TreeBuild {
+     std::vector<RPNode> nodes;
+     std::vector<float> normals;
+     std::vector<int32_t> items;
+ };
+
+ size_t alignUp(size_t offset) {
+     return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+ }
+
+ float margin(const float* normal, float offset, const float* x, int dims) {
+     float dot = offset;
+     for (int j = 0; j < dims; ++j) dot += normal[j] * x[j];
+     return dot;
+ }
+
+ // Recursively splits idx[lo, hi) and returns the tree-local index of the new node.
+ int32_t buildNode(TreeBuild& tree, std::vector<int32_t>& idx, size_t lo, size_t hi,
+                   const std::vector<Document>& docs, int dims, int leafSize, std::mt19937& gen) {
+     int32_t self = (int32_t)tree.nodes.size();
+     tree.nodes.push_back({-1, -1, 0, 0, 0.0f});
+     size_t count = hi - lo;
+
+     if (count <= (size_t)leafSize) {
+         tree.nodes[self].begin = (uint32_t)tree.items.size();
+         tree.nodes[self].count = (uint32_t)count;
+         tree.items.insert(tree.items.end(), idx.begin() + lo, idx.begin() + hi);
+         return self;
+     }
+
+     // The hyperplane is the perpendicular bisector of two sampled points.
+     std::uniform_int_distribution<size_t> pick(lo, hi - 1);
+     const std::vector<float>& a = docs[idx[pick(gen)]].features;
+     const std::vector<float>& b = docs[idx[pick(gen)]].features;
+     std::vector<float> normal(dims);
+     float norm = 0.0f, offset = 0.0f;
+     for (int j = 0; j < dims; ++j) {
+         normal[j] = a[j] - b[j];
+         norm += normal[j] * normal[j];
+     }
+     norm = std::sqrt(norm);
+
+     size_t mid = lo;
+     if (norm > 0.0f) {
+         for (int j = 0; j < dims; ++j) {
+             normal[j] /= norm;
+             offset -= normal[j] * (a[j] + b[j]) * 0.5f;
+         }
+         mid = std::partition(idx.begin() + lo, idx.begin() + hi, [&](int32_t i) {
+             return margin(normal.data(), offset, docs[i].features.data(), dims) <= 0.0f;
+         }) - idx.begin();
+     }
+
+     // Degenerate split (duplicate samples or all points on one side): fall back
+     // to an even split with a zero hyperplane, so searches explore both halves.
+     if (mid == lo || mid == hi) {
+         std::fill(normal.begin(), normal.end(), 0.0f);
+         offset = 0.0f;
+         mid = lo + count / 2;
+     }
+
+     tree.nodes[self].begin = (uint32_t)(tree.normals.size() / dims);
+     tree.nodes[self].offset = offset;
+     tree.normals.insert(tree.normals.end(), normal.begin(), normal.end());
+
+     int32_t left = buildNode(tree, idx, lo, mid, docs, dims, leafSize, gen);
+     int32_t right = buildNode(tree, idx, mid, hi, docs, dims, leafSize, gen);
+     tree.nodes[self].left = left;
+     tree.nodes[self].right = right;
+     return self;
+ }
+
+ } // namespace
+
+ //=============================================================================
+ // Construction
+ //=============================================================================
+
+ RPForest::RPForest(int dimensions, int nTrees, int maxLeafSize, unsigned randomSeed)
+     : dims(dimensions), numTrees(nTrees), leafSize(std::max(1, maxLeafSize)), seed(randomSeed) {}
+
+ RPForest::~RPForest() {
+     unmap();
+ }
+
+ void RPForest::unmap() {
+     if (mappedImage != nullptr) {
+         munmap(mappedImage, mappedSize);
+         mappedImage = nullptr;
+         mappedSize = 0;
+     }
+ }
+
+ void RPForest::insert(const Document& d) {
+     staged.push_back(d);
+ }
+
+ bool RPForest::build(int numThreads) {
+     unmap();
+     ownedImage.clear();
+     numDocs = 0;
+     if (numTrees <= 0) {
+         std::cerr << "Error: A random projection forest needs at least one tree." << std::endl;
+         return false;
+     }
+     if (staged.empty()) return true;
+
+     // Every tree has its own generator, so the result does not depend on the
+     // number of threads or on which thread builds which tree.
+     std::vector<TreeBuild> trees(numTrees);
+     std::vector<int32_t> treeRoots(numTrees);
+     std::atomic<int> nextTree(0);
+
+     auto worker = [&]() {
+         for (int t = nextTree++; t < numTrees; t = nextTree++) {
+             std::mt19937 gen(seed + t);
+             std::vector<int32_t> idx(staged.size());
+             for (size_t i = 0; i < idx.size(); ++i) idx[i] = (int32_t)i;
+             treeRoots[t] = buildNode(trees[t], idx, 0, idx.size(), staged, dims, leafSize, gen);
+         }
+     };
+
+     if (numThreads <= 0) numThreads = std::max(1u, std::thread::hardware_concurrency());
+     numThreads = std::min(numThreads, numTrees);
+     std::vector<std::thread> pool;
+     for (int i = 1; i < numThreads; ++i) pool.emplace_back(worker);
+     worker();
+     for (auto& th : pool) th.join();
+
+     // Lay out the flat image.
+     uint64_t totalNodes = 0, totalNormals = 0, totalItems = 0, nameBytes = 0;
+     for (const auto& t : trees) {
+         totalNodes += t.nodes.size();
+         totalNormals += t.normals.size() / dims;
+         totalItems += t.items.size();
+     }
+     for (const auto& d : staged) nameBytes += d.filename.size();
+     // Node and document indices are stored as int32, the counts and name offsets as uint32.
+     const uint64_t INDEX_LIMIT = INT32_MAX;
+     if (totalNodes > INDEX_LIMIT || staged.size() > INDEX_LIMIT || totalNormals > UINT32_MAX ||
+         totalItems > UINT32_MAX || nameBytes > UINT32_MAX) {
+         std::cerr << "Error: The random projection forest is too large for its image format." << std::endl;
+         return false;
+     }
+
+     RPForestHeader header;
+     std::memcpy(header.magic, RP_FOREST_MAGIC, sizeof(header.magic));
+     header.version = RP_FOREST_VERSION;
+     header.dims = dims;
+     header.numDocs = (uint32_t)staged.size();
+     header.numTrees = numTrees;
+     header.numNodes = (uint32_t)totalNodes;
+     header.numNormals = (uint32_t)totalNormals;
+     header.numLeafItems = (uint32_t)totalItems;
+     header.rootsOffset = alignUp(sizeof(RPForestHeader));
+     header.nodesOffset = alignUp(header.rootsOffset + numTrees * sizeof(int32_t));
+     header.normalsOffset = alignUp(header.nodesOffset + totalNodes * sizeof(RPNode));
+     header.leafItemsOffset = alignUp(header.normalsOffset + (size_t)totalNormals * dims * sizeof(float));
+     header.featuresOffset = alignUp(header.leafItemsOffset + totalItems * sizeof(int32_t));
+     header.idsOffset = alignUp(header.featuresOffset + staged.size() * dims * sizeof(float));
+     header.nameOffsetsOffset = alignUp(header.idsOffset + staged.size() * sizeof(int32_t));
+     header.namesOffset = alignUp(header.nameOffsetsOffset + (staged.size() + 1) * sizeof(uint32_t));
+     header.imageSize = header.namesOffset + nameBytes;
+
+     ownedImage.assign(header.imageSize, 0);
+     char* base = ownedImage.data();
+     std::memcpy(base, &header, sizeof(header));
+
+     // Copy the trees, shifting their local indices to global ones.
+     int32_t* outRoots = reinterpret_cast<int32_t*>(base + header.rootsOffset);
+     RPNode* outNodes = reinterpret_cast<RPNode*>(base + header.nodesOffset);
+     float* outNormals = reinterpret_cast<float*>(base + header.normalsOffset);
+     int32_t* outItems = reinterpret_cast<int32_t*>(base + header.leafItemsOffset);
+     uint32_t nodeBase = 0, normalBase = 0, itemBase = 0;
+     for (int t = 0; t < numTrees; ++t) {
+         outRoots[t] = treeRoots[t] + nodeBase;
+         for (size_t i = 0; i < trees[t].nodes.size(); ++i) {
+             RPNode n = trees[t].nodes[i];
+             bool leaf = n.left < 0;
+             if (!leaf) {
+                 n.left += nodeBase;
+                 n.right += nodeBase;
+             }
+             n.begin += leaf ? itemBase : normalBase;
+             outNodes[nodeBase + i] = n;
+         }
+         nodeBase += (uint32_t)trees[t].nodes.size();
+         std::copy(trees[t].normals.begin(), trees[t].normals.end(), outNormals + (size_t)normalBase * dims);
+         normalBase += (uint32_t)(trees[t].normals.size() / dims);
+         std::copy(trees[t].items.begin(), trees[t].items.end(), outItems + itemBase);
+         itemBase += (uint32_t)trees[t].items.size();
+     }
+
+     float* outFeatures = reinterpret_cast<float*>(base + header.featuresOffset);
+     int32_t* outIds = reinterpret_cast<int32_t*>(base + header.idsOffset);
+     uint32_t* outNameOffsets = reinterpret_cast<uint32_t*>(base + header.nameOffsetsOffset);
+     char* outNames = base + header.namesOffset;
+     uint32_t nameCursor = 0;
+     for (size_t i = 0; i < staged.size(); ++i) {
+         std::copy(staged[i].features.begin(), staged[i].features.end(), outFeatures + i * dims);
+         outIds[i] = staged[i].id;
+         outNameOffsets[i] = nameCursor;
+         std::memcpy(outNames + nameCursor, staged[i].filename.data(), staged[i].filename.size());
+         nameCursor += (uint32_t)staged[i].filename.size();
+     }
+     outNameOffsets[staged.size()] = nameCursor;
+
+     if (!attach(base, ownedImage.size())) {
+         std::cerr << "Error: The random projection forest image failed validation." << std::endl;
+         ownedImage.clear();
+         return false;
+     }
+     return true;
+ }
+
+ //=============================================================================
+ // Flat Image Access
+ //=============================================================================
+
+ bool RPForest::attach(const char* image, size_t size) {
+     if (size < sizeof(RPForestHeader)) return false;
+     RPForestHeader header;
+     std::memcpy(&header, image, sizeof(header));
+     if (std::memcmp(header.magic, RP_FOREST_MAGIC, sizeof(header.magic)) != 0 ||
+         header.version != RP_FOREST_VERSION || header.imageSize != size ||
+         (int)header.dims != dims || header.numTrees == 0) {
+         return false;
+     }
+
+     // Every section must end inside the image.
+     struct Section { uint64_t offset; uint64_t bytes; };
+     const Section sections[] = {
+         {header.rootsOffset, header.numTrees * sizeof(int32_t)},
+         {header.nodesOffset, header.numNodes * sizeof(RPNode)},
+         {header.normalsOffset, (uint64_t)header.numNormals * dims * sizeof(float)},
+         {header.leafItemsOffset, header.numLeafItems * sizeof(int32_t)},
+         {header.featuresOffset, (uint64_t)header.numDocs * dims * sizeof(float)},
+         {header.idsOffset, header.numDocs * sizeof(int32_t)},
+         {header.nameOffsetsOffset, (header.numDocs + 1) * sizeof(uint32_t)},
+     };
+     for (const auto& s : sections) {
+         if (s.offset + s.bytes > size) return false;
+     }
+
+     // Searches follow these indices unchecked. Children always come after their
+     // parent (preorder), which also rules out cycles.
+     const int32_t* rootList = reinterpret_cast<const int32_t*>(image + header.rootsOffset);
+     for (uint32_t t = 0; t < header.numTrees; ++t) {
+         if (rootList[t] < 0 || (uint32_t)rootList[t] >= header.numNodes) return false;
+     }
+     RPNode n;
+     for (uint32_t i = 0; i < header.numNodes; ++i) {
+         std::memcpy(&n, image + header.nodesOffset + i * sizeof(RPNode), sizeof(n));
+         if (n.left < 0) {
+             if (n.right >= 0 || (uint64_t)n.begin + n.count > header.numLeafItems) return false;
+         } else if ((uint32_t)n.left <= i || (uint32_t)n.left >= header.numNodes ||
+                    n.right < 0 || (uint32_t)n.right <= i || (uint32_t)n.right >= header.numNodes ||
+                    n.begin >= header.numNormals) {
+             return false;
+         }
+     }
+     const int32_t* items = reinterpret_cast<const int32_t*>(image + header.leafItemsOffset);
+     for (uint32_t i = 0; i < header.numLeafItems; ++i) {
+         if (items[i] < 0 || (uint32_t)items[i] >= header.numDocs) return false;
+     }
+     const uint32_t* offsets = reinterpret_cast<const uint32_t*>(image + header.nameOffsetsOffset);
+     for (uint32_t i = 0; i < header.numDocs; ++i) {
+         if (offsets[i] > offsets[i + 1]) return false;
+     }
+     if (header.namesOffset > size || offsets[header.numDocs] > size - header.namesOffset) return false;
+
+     numTrees = (int)header.numTrees;
+     numDocs = header.numDocs;
+     roots = reinterpret_cast<const int32_t*>(image + header.rootsOffset);
+     nodes = reinterpret_cast<const RPNode*>(image + header.nodesOffset);
+     normals = reinterpret_cast<const float*>(image + header.normalsOffset);
+     leafItems = reinterpret_cast<const int32_t*>(image + header.leafItemsOffset);
+     features = reinterpret_cast<const float*>(image + header.featuresOffset);
+     ids = reinterpret_cast<const int32_t*>(image + header.idsOffset);
+     nameOffsets = reinterpret_cast<const uint32_t*>(image + header.nameOffsetsOffset);
+     names = image + header.namesOffset;
+     return true;
+ }
+
+ bool RPForest::save(const std::string& path) const {
+     const char* image = mappedImage != nullptr ? static_cast<const char*>(mappedImage) : ownedImage.data();
+     size_t size = mappedImage != nullptr ? mappedSize : ownedImage.size();
+     std::ofstream out(path, std::ios::binary);
+     if (!out.is_open()) {
+         std::cerr << "Error: Could not open " << path << " for writing." << std::endl;
+         return false;
+     }
+     out.write(image, size);
+     return static_cast<bool>(out);
+ }
+
+ bool RPForest::load(const std::string& path) {
+     int fd = open(path.c_str(), O_RDONLY);
+     if (fd < 0) {
+         std::cerr << "Error: Could not open " << path << " for reading." << std::endl;
+         return false;
+     }
+     struct stat st;
+     void* image = MAP_FAILED;
+     if (fstat(fd, &st) == 0 && st.st_size > 0) {
+         image = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+     }
+     close(fd); // The mapping keeps the file alive.
+     if (image == MAP_FAILED) {
+         std::cerr << "Error: Could not map " << path << "." << std::endl;
+         return false;
+     }
+
+     unmap();
+     ownedImage.clear();
+     mappedImage = image;
+     mappedSize = st.st_size;
+     if (!attach(static_cast<const char*>(image), mappedSize)) {
+         std::cerr << "Error: " << path << " is not a valid forest for " << dims << " dimensions." << std::endl;
+         unmap();
+         numDocs = 0;
+         return false;
+     }
+     return true;
+ }
+
+ //=============================================================================
+ // K-Nearest Neighbor Search
+ //=============================================================================
+
+ std::vector<Document> RPForest::searchSimilar(const Document& query, int k, int searchK) const {
+     if (numDocs == 0 || k <= 0) return {};
+     if (searchK < 0) searchK = k * numTrees;
+
+     // Best-first descent over all trees at once: a node's priority is the
+     // smallest margin seen on the way down, i.e. how close the query came to
+     // falling on the other side of a split.
+     std::priority_queue<std::pair<float, int32_t>> frontier;
+     for (int t = 0; t < numTrees; ++t) frontier.push({FLT_MAX, roots[t]});
+
+     std::vector<int32_t> candidates;
+     while (!frontier.empty() && (int)candidates.size() < searchK) {
+         auto [priority, nodeIndex] = frontier.top();
+         frontier.pop();
+         const RPNode& n = nodes[nodeIndex];
+         if (n.left < 0) {
+             candidates.insert(candidates.end(), leafItems + n.begin, leafItems + n.begin + n.count);
+             continue;
+         }
+         float m = margin(normals + (size_t)n.begin * dims, n.offset, query.features.data(), dims);
+         frontier.push({std::min(priority, m), n.right});
+         frontier.push({std::min(priority, -m), n.left});
+     }
+
+     // The same document is usually found by several trees.
+     std::sort(candidates.begin(), candidates.end());
+     candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+     std::vector<std::pair<float, int32_t>> distances;
+     distances.reserve(candidates.size());
+     for (int32_t c : candidates) {
+         const float* x = features + (size_t)c * dims;
+         float sum = 0.0f;
+         for (int j = 0; j < dims; ++j) {
+             float diff = query.features[j] - x[j];
+             sum += diff * diff;
+         }
+         distances.push_back({std::sqrt(sum), c});
+     }
+     int result_count = std::min(k, (int)distances.size());
+     std::partial_sort(distances.begin(), distances.begin() + result_count, distances.end());
+
+     std::vector<Document> results;
+     for (int i = 0; i < result_count; ++i) {
+         int32_t c = distances[i].second;
+         const float* x = features + (size_t)c * dims;
+         results.emplace_back(ids[c], std::vector<float>(x, x + dims),
+                              std::string(names + nameOffsets[c], nameOffsets[c + 1] - nameOffsets[c]));
+     }
+     return results;
+ }
@@ -0,0 +1,308 @@
+/**
+ * @file StreamingDecoder.cpp
+ * @brief Implements band-by-band JPEG and PNG decoding for the histogram features.
+ *
+ * Both libraries report fatal errors with longjmp(), so the decoding functions
+ * below keep only plain C objects alive across their setjmp() points.
+ */
+
+ #include "StreamingDecoder.h"
+ #include <algorithm> // for std::min, std::swap
+ #include <csetjmp>
+ #include <cstring>
+
+ #ifdef HAVE_LIBJPEG
+ extern "C" {
+ #include <jpeglib.h>
+ }
+ #endif
+ #ifdef HAVE_LIBPNG
+ #include <png.h>
+ #endif
+
+ namespace {
+
+ const unsigned char JPEG_SIGNATURE[3] = {0xFF, 0xD8, 0xFF};
+ const unsigned char PNG_SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+ #ifdef HAVE_LIBJPEG
+ struct JpegErrorManager {
+     jpeg_error_mgr pub;
+     jmp_buf jump;
+ };
+
+ void jpegErrorExit(j_common_ptr cinfo) {
+     char message[JMSG_LENGTH_MAX];
+     (*cinfo->err->format_message)(cinfo, message);
+     std::cerr << "Error: libjpeg: " << message << std::endl;
+     longjmp(reinterpret_cast<JpegErrorManager*>(cinfo->err)->jump, 1);
+ }
+
+ // The EXIF orientation tag (1-8) of a saved APP1 marker list; 1 (as stored) if absent.
+ int exifOrientation(jpeg_saved_marker_ptr marker) {
+     for (; marker != nullptr; marker = marker->next) {
+         const unsigned char* p = marker->data;
+         unsigned length = marker->data_length;
+         if (marker->marker != JPEG_APP0 + 1 || length < 14 || std::memcmp(p, "Exif\0\0", 6) != 0) continue;
+         const unsigned char* tiff = p + 6;
+         unsigned size = length - 6;
+         bool little = tiff[0] == 'I';
+         auto read16 = [&](unsigned at) { return little ? tiff[at] | tiff[at + 1] << 8 : tiff[at] << 8 | tiff[at + 1]; };
+         auto read32 = [&](unsigned at) {
+             return little ? (uint32_t)read16(at) | (uint32_t)read16(at + 2) << 16
+                           : (uint32_t)read16(at) << 16 | (uint32_t)read16(at + 2);
+         };
+         uint32_t ifd = read32(4);
+         if (ifd > size - 2) return 1;
+         unsigned entries = read16(ifd);
+         for (unsigned e = 0; e < entries && ifd + 2 + (e + 1) * 12 <= size; e++) {
+             unsigned entry = ifd + 2 + e * 12;
+             if (read16(entry) == 0x0112) return read16(entry + 8);
+         }
+         return 1;
+     }
+     return 1;
+ }
+ #endif
+
+ #ifdef HAVE_LIBPNG
+ void pngError(png_structp png, png_const_charp message) {
+     std::cerr << "Error: libpng: " << message << std::endl;
+     png_longjmp(png, 1);
+ }
+
+ void pngWarning(png_structp, png_const_charp) {}
+ #endif
+
+ } // namespace
+
+ //=============================================================================
+ // Band Accumulation
+ //=============================================================================
+
+ void StreamingExtractor::beginImage(int rows, int cols) {
+     band.create(BAND_ROWS, cols, CV_8UC3);
+     std::memset(counts, 0, sizeof(counts));
+     dhash.begin(rows, cols);
+     if (integralOut) integralOut->begin(rows, cols);
+     if (thumbnailOut) thumbnailOut->begin(rows, cols, thumbnailSideOut);
+ }
+
+ void StreamingExtractor::addBand(int firstRow, int rows) {
+     cv::Mat rowsView = band(cv::Rect(0, 0, band.cols, rows));
+     accumulateHistogram(rowsView, counts);
+     if (hashOut) dhash.addRows(rowsView, firstRow);
+     if (integralOut) integralOut->addRows(rowsView, firstRow);
+     if (thumbnailOut) thumbnailOut->addRows(rowsView, firstRow);
+ }
+
+ StreamStatus StreamingExtractor::extractFile(const std::string& path, float* out, uint64_t* perceptualHash,
+                                              IntegralHistogram* integral, ThumbnailBuilder* thumbnail,
+                                              int thumbnailSide) {
+     FILE* file = std::fopen(path.c_str(), "rb");
+     if (!file) {
+         std::cerr << "Error: Could not open the image at: " << path << std::endl;
+         return StreamStatus::Failed;
+     }
+
+     unsigned char signature[8] = {};
+     size_t signatureSize = std::fread(signature, 1, sizeof(signature), file);
+     std::rewind(file);
+
+     hashOut = perceptualHash;
+     integralOut = integral;
+     thumbnailOut = thumbnail;
+     thumbnailSideOut = thumbnailSide;
+     StreamStatus status = StreamStatus::Unsupported;
+     if (signatureSize >= sizeof(JPEG_SIGNATURE) && std::memcmp(signature, JPEG_SIGNATURE, sizeof(JPEG_SIGNATURE)) == 0) {
+         status = decodeJpeg(file);
+     } else if (signatureSize == sizeof(PNG_SIGNATURE) && std::memcmp(signature, PNG_SIGNATURE, sizeof(PNG_SIGNATURE)) == 0) {
+         status = decodePng(file);
+     }
+     std::fclose(file);
+
+     if (status == StreamStatus::Extracted) {
+         normalizeHistogram(counts, out);
+         if (perceptualHash) *perceptualHash = dhash.finish();
+         if (integral) integral->finish();
+     }
+     hashOut = nullptr;
+     integralOut = nullptr;
+     thumbnailOut = nullptr;
+     return status;
+ }
+
+ bool StreamingExtractor::readImageSize(const std::string& path, int& rows, int& cols) {
+     FILE* file = std::fopen(path.c_str(), "rb");
+     if (!file) return false;
+     unsigned char signature[8] = {};
+     size_t signatureSize = std::fread(signature, 1, sizeof(signature), file);
+     std::rewind(file);
+
+     bool found = false;
+     if (signatureSize >= sizeof(JPEG_SIGNATURE) && std::memcmp(signature, JPEG_SIGNATURE, sizeof(JPEG_SIGNATURE)) == 0) {
+ #ifdef HAVE_LIBJPEG
+         jpeg_decompress_struct cinfo;
+         JpegErrorManager jerr;
+         cinfo.err = jpeg_std_error(&jerr.pub);
+         jerr.pub.error_exit = jpegErrorExit;
+         if (setjmp(jerr.jump) == 0) {
+             jpeg_create_decompress(&cinfo);
+             jpeg_stdio_src(&cinfo, file);
+             jpeg_read_header(&cinfo, TRUE);
+             rows = (int)cinfo.image_height;
+             cols = (int)cinfo.image_width;
+             found = true;
+         }
+         jpeg_destroy_decompress(&cinfo);
+ #endif
+     } else if (signatureSize == sizeof(PNG_SIGNATURE) && std::memcmp(signature, PNG_SIGNATURE, sizeof(PNG_SIGNATURE)) == 0) {
+ #ifdef HAVE_LIBPNG
+         png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, pngError, pngWarning);
+         png_infop info = png ? png_create_info_struct(png) : nullptr;
+         if (info && setjmp(png_jmpbuf(png)) == 0) {
+             png_init_io(png, file);
+             png_read_info(png, info);
+             rows = (int)png_get_image_height(png, info);
+             cols = (int)png_get_image_width(png, info);
+             found = true;
+         }
+         if (png) png_destroy_read_struct(&png, info ? &info : nullptr, nullptr);
+ #endif
+     }
+     std::fclose(file);
+ #if !defined(HAVE_LIBJPEG) && !defined(HAVE_LIBPNG)
+     (void)rows;
+     (void)cols;
+ #endif
+     return found;
+ }
+
+ //=============================================================================
+ // JPEG (libjpeg scanline decoding)
+ //=============================================================================
+
+ StreamStatus StreamingExtractor::decodeJpeg(FILE* file) {
+ #ifdef HAVE_LIBJPEG
+     jpeg_decompress_struct cinfo;
+     JpegErrorManager jerr;
+     cinfo.err = jpeg_std_error(&jerr.pub);
+     jerr.pub.error_exit = jpegErrorExit;
+     if (setjmp(jerr.jump)) {
+         jpeg_destroy_decompress(&cinfo);
+         return StreamStatus::Failed;
+     }
+     jpeg_create_decompress(&cinfo);
+     jpeg_stdio_src(&cinfo, file);
+     jpeg_save_markers(&cinfo, JPEG_APP0 + 1, 0xFFFF);
+     jpeg_read_header(&cinfo, TRUE);
+
+     // cv::imdecode rotates by the EXIF orientation; the band accumulators only
+     // see rows in file order, so a rotated or mirrored photo takes that path.
+     int orientation = exifOrientation(cinfo.marker_list);
+     if (orientation > 1 && orientation <= 8) {
+         jpeg_destroy_decompress(&cinfo);
+         return StreamStatus::Unsupported;
+     }
+
+     // CMYK and YCCK files need an inversion step OpenCV applies; leave them to it.
+     bool gray = cinfo.jpeg_color_space == JCS_GRAYSCALE;
+     if (!gray && cinfo.num_components != 3) {
+         jpeg_destroy_decompress(&cinfo);
+         return StreamStatus::Unsupported;
+     }
+ #ifdef JCS_EXTENSIONS
+     cinfo.out_color_space = gray ? JCS_GRAYSCALE : JCS_EXT_BGR;
+     bool swapRedBlue = false;
+ #else
+     cinfo.out_color_space = gray ? JCS_GRAYSCALE : JCS_RGB;
+     bool swapRedBlue = !gray;
+ #endif
+     jpeg_start_decompress(&cinfo);
+     beginImage((int)cinfo.output_height, (int)cinfo.output_width);
+
+     JSAMPROW rowPointers[BAND_ROWS];
+     int cols = (int)cinfo.output_width;
+     while (cinfo.output_scanline < cinfo.output_height) {
+         int firstRow = (int)cinfo.output_scanline;
+         int rows = 0;
+         while (rows < BAND_ROWS && cinfo.output_scanline < cinfo.output_height) {
+             for (int r = rows; r < BAND_ROWS; r++) rowPointers[r - rows] = band.ptr<unsigned char>(r);
+             rows += (int)jpeg_read_scanlines(&cinfo, rowPointers, BAND_ROWS - rows);
+         }
+         for (int r = 0; r < rows; r++) {
+             unsigned char* px = band.ptr<unsigned char>(r);
+             if (gray) {
+                 // Expand in place from the right end so no sample is overwritten before it is read.
+                 for (int c = cols - 1; c >= 0; c--) px[c * 3] = px[c * 3 + 1] = px[c * 3 + 2] = px[c];
+             } else if (swapRedBlue) {
+                 for (int c = 0; c < cols; c++) std::swap(px[c * 3], px[c * 3 + 2]);
+             }
+         }
+         addBand(firstRow, rows);
+     }
+
+     jpeg_finish_decompress(&cinfo);
+     jpeg_destroy_decompress(&cinfo);
+     return StreamStatus::Extracted;
+ #else
+     (void)file;
+     return StreamStatus::Unsupported;
+ #endif
+ }
+
+ //=============================================================================
+ // PNG (libpng row decoding)
+ //=============================================================================
+
+ StreamStatus StreamingExtractor::decodePng(FILE* file) {
+ #ifdef HAVE_LIBPNG
+     png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, pngError, pngWarning);
+     if (!png) return StreamStatus::Failed;
+     png_infop info = png_create_info_struct(png);
+     if (!info) {
+         png_destroy_read_struct(&png, nullptr, nullptr);
+         return StreamStatus::Failed;
+     }
+     if (setjmp(png_jmpbuf(png))) {
+         png_destroy_read_struct(&png, &info, nullptr);
+         return StreamStatus::Failed;
+     }
+     png_init_io(png, file);
+     png_read_info(png, info);
+
+     // Interlaced rows only become final in the last pass, which needs the whole image.
+     if (png_get_interlace_type(png, info) != PNG_INTERLACE_NONE) {
+         png_destroy_read_struct(&png, &info, nullptr);
+         return StreamStatus::Unsupported;
+     }
+
+     // Convert every color type to 8-bit BGR, as cv::imread(IMREAD_COLOR) does.
+     png_set_expand(png);
+     png_set_strip_16(png);
+     png_set_strip_alpha(png);
+     png_set_gray_to_rgb(png);
+     png_set_bgr(png);
+     png_read_update_info(png, info);
+
+     int rows = (int)png_get_image_height(png, info);
+     int cols = (int)png_get_image_width(png, info);
+     if (png_get_rowbytes(png, info) != (size_t)cols * 3) {
+         png_destroy_read_struct(&png, &info, nullptr);
+         return StreamStatus::Unsupported;
+     }
+     beginImage(rows, cols);
+     for (int firstRow = 0; firstRow < rows; firstRow += BAND_ROWS) {
+         int n = std::min(BAND_ROWS, rows - firstRow);
+         for (int r = 0; r < n; r++) png_read_row(png, band.ptr<unsigned char>(r), nullptr);
+         addBand(firstRow, n);
+     }
+
+     png_read_end(png, nullptr);
+     png_destroy_read_struct(&png, &info, nullptr);
+     return StreamStatus::Extracted;
+ #else
+     (void)file;
+     return StreamStatus::Unsupported;
+ #endif
+ }
@@ -0,0 +1,311 @@
+/**
+ * @file ThumbnailStore.cpp
+ * @brief Implements thumbnail downsampling and the memory-mapped thumbnail file.
+ */
+
+ #include "ThumbnailStore.h"
+ #include <algorithm> // for std::max, std::min
+ #include <cstring>
+ #include <iostream>
+
+ #include <fcntl.h>
+ #include <sys/mman.h>
+ #include <sys/stat.h>
+ #include <unistd.h>
+
+ namespace {
+
+ const char THUMBNAIL_MAGIC[4] = {'T', 'H', 'M', 'B'};
+ const uint32_t THUMBNAIL_VERSION = 2;
+ const size_t SECTION_ALIGNMENT = 64;
+
+ // Header at the start of the file. The pixel section holds count slots of
+ // side * side * 3 bytes each, back to back, in the order of the image names.
+ // complete is written last, once every slot has been attempted.
+ struct ThumbnailHeader {
+     char magic[4];
+     uint32_t version;
+     uint64_t count;
+     uint32_t side;
+     uint32_t complete;
+     uint64_t sizesOffset;
+     uint64_t stampsOffset;
+     uint64_t nameOffsetsOffset;
+     uint64_t namesOffset;
+     uint64_t pixelsOffset;
+     uint64_t fileSize;
+ };
+
+ size_t alignUp(size_t offset) {
+     return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+ }
+
+ // Source pixel range [begin, end) of thumbnail cell i; an image smaller than
+ // the thumbnail repeats its pixels instead of leaving cells empty.
+ void cellRange(int i, int pixels, int cells, int& begin, int& end) {
+     begin = std::min(i * pixels / cells, pixels - 1);
+     end = std::max(begin + 1, (i + 1) * pixels / cells);
+ }
+
+ } // namespace
+
+ //=============================================================================
+ // ThumbnailBuilder Implementation
+ //=============================================================================
+
+ void ThumbnailBuilder::begin(int rows, int cols, int thumbnailSide) {
+     side = thumbnailSide;
+     imageRows = rows;
+     imageCols = cols;
+     sums.assign((size_t)side * side * 3, 0);
+ }
+
+ void ThumbnailBuilder::addRows(const cv::Mat& band, int firstRow) {
+     for (int ty = 0; ty < side; ty++) {
+         int cellBegin, cellEnd;
+         cellRange(ty, imageRows, side, cellBegin, cellEnd);
+         int r0 = std::max(firstRow, cellBegin), r1 = std::min(firstRow + band.rows, cellEnd);
+         uint64_t* acc = &sums[(size_t)ty * side * 3];
+         for (int r = r0; r < r1; r++) {
+             const unsigned char* row = band.ptr<unsigned char>(r - firstRow);
+             for (int tx = 0; tx < side; tx++) {
+                 int c0, c1;
+                 cellRange(tx, imageCols, side, c0, c1);
+                 const unsigned char* px = row + c0 * 3;
+                 uint64_t b = 0, g = 0, red = 0;
+                 for (int c = c0; c < c1; c++, px += 3) {
+                     b += px[0];
+                     g += px[1];
+                     red += px[2];
+                 }
+                 acc[tx * 3] += b;
+                 acc[tx * 3 + 1] += g;
+                 acc[tx * 3 + 2] += red;
+             }
+         }
+     }
+ }
+
+ void ThumbnailBuilder::finish(unsigned char* out) const {
+     for (int ty = 0; ty < side; ty++) {
+         int r0, r1;
+         cellRange(ty, imageRows, side, r0, r1);
+         for (int tx = 0; tx < side; tx++) {
+             int c0, c1;
+             cellRange(tx, imageCols, side, c0, c1);
+             uint64_t area = (uint64_t)(r1 - r0) * (c1 - c0);
+             const uint64_t* s = &sums[((size_t)ty * side + tx) * 3];
+             unsigned char* px = out + ((size_t)ty * side + tx) * 3;
+             for (int ch = 0; ch < 3; ch++) px[ch] = (unsigned char)((s[ch] + area / 2) / area);
+         }
+     }
+ }
+
+ //=============================================================================
+ // ThumbnailStore Implementation
+ //=============================================================================
+
+ ThumbnailStore::~ThumbnailStore() {
+     close();
+ }
+
+ void ThumbnailStore::close() {
+     if (mappedImage != nullptr) {
+         munmap(mappedImage, mappedSize);
+         mappedImage = nullptr;
+     }
+     mappedSize = 0;
+     writable = false;
+     count = 0;
+     side = 0;
+ }
+
+ bool ThumbnailStore::attach(size_t size) {
+     const char* image = static_cast<const char*>(mappedImage);
+     if (size < sizeof(ThumbnailHeader)) return false;
+     ThumbnailHeader header;
+     std::memcpy(&header, image, sizeof(header));
+     if (std::memcmp(header.magic, THUMBNAIL_MAGIC, sizeof(header.magic)) != 0 ||
+         header.version != THUMBNAIL_VERSION || header.fileSize != size || header.side == 0) {
+         return false;
+     }
+
+     // Every section must end inside the file. The counts are divided into the
+     // room left rather than multiplied, so a huge count cannot wrap past the checks.
+     auto fits = [size](uint64_t offset, uint64_t items, uint64_t itemBytes) {
+         return offset <= size && items <= (size - offset) / itemBytes;
+     };
+     if (header.side > 0xFFFF) return false;
+     uint64_t slot = (uint64_t)header.side * header.side * 3;
+     if (header.count >= size || !fits(header.sizesOffset, header.count, 2 * sizeof(uint32_t)) ||
+         !fits(header.stampsOffset, header.count, sizeof(SourceStamp)) ||
+         !fits(header.nameOffsetsOffset, header.count + 1, sizeof(uint32_t)) ||
+         !fits(header.pixelsOffset, header.count, slot) || header.namesOffset > header.pixelsOffset) {
+         return false;
+     }
+
+     // name() slices names with these offsets unchecked.
+     const uint32_t* offsets = reinterpret_cast<const uint32_t*>(image + header.nameOffsetsOffset);
+     if (offsets[0] != 0) return false;
+     for (uint64_t i = 0; i < header.count; i++) {
+         if (offsets[i] > offsets[i + 1]) return false;
+     }
+     if (offsets[header.count] > header.pixelsOffset - header.namesOffset) return false;
+
+     count = header.count;
+     side = (int)header.side;
+     originalSizes = reinterpret_cast<uint32_t*>(static_cast<char*>(mappedImage) + header.sizesOffset);
+     stamps = reinterpret_cast<SourceStamp*>(static_cast<char*>(mappedImage) + header.stampsOffset);
+     nameOffsets = reinterpret_cast<const uint32_t*>(image + header.nameOffsetsOffset);
+     names = image + header.namesOffset;
+     pixels = static_cast<unsigned char*>(mappedImage) + header.pixelsOffset;
+     return true;
+ }
+
+ bool ThumbnailStore::create(const std::string& path, const std::vector<std::string>& imageNames, int thumbnailSide) {
+     close();
+
+     ThumbnailHeader header = {};
+     std::memcpy(header.magic, THUMBNAIL_MAGIC, sizeof(header.magic));
+     header.version = THUMBNAIL_VERSION;
+     header.count = imageNames.size();
+     header.side = (uint32_t)std::max(1, thumbnailSide);
+
+     size_t namesBytes = 0;
+     for (const auto& n : imageNames) namesBytes += n.size();
+     header.sizesOffset = alignUp(sizeof(ThumbnailHeader));
+     header.stampsOffset = alignUp(header.sizesOffset + header.count * 2 * sizeof(uint32_t));
+     header.nameOffsetsOffset = alignUp(header.stampsOffset + header.count * sizeof(SourceStamp));
+     header.namesOffset = header.nameOffsetsOffset + (header.count + 1) * sizeof(uint32_t);
+     header.pixelsOffset = alignUp(header.namesOffset + namesBytes);
+     header.fileSize = header.pixelsOffset + header.count * header.side * header.side * 3;
+
+     // The file is sized up front and stays sparse until workers fill the slots.
+     int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+     if (fd < 0) {
+         std::cerr << "Error: Could not open " << path << " for writing." << std::endl;
+         return false;
+     }
+     void* image = MAP_FAILED;
+     if (ftruncate(fd, (off_t)header.fileSize) == 0) {
+         image = mmap(nullptr, header.fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+     }
+     ::close(fd); // The mapping keeps the file alive.
+     if (image == MAP_FAILED) {
+         std::cerr << "Error: Could not map " << path << "." << std::endl;
+         return false;
+     }
+
+     char* base = static_cast<char*>(image);
+     std::memcpy(base, &header, sizeof(header));
+     uint32_t* offsets = reinterpret_cast<uint32_t*>(base + header.nameOffsetsOffset);
+     uint32_t offset = 0;
+     for (size_t i = 0; i < imageNames.size(); i++) {
+         offsets[i] = offset;
+         std::memcpy(base + header.namesOffset + offset, imageNames[i].data(), imageNames[i].size());
+         offset += (uint32_t)imageNames[i].size();
+     }
+     offsets[imageNames.size()] = offset;
+
+     mappedImage = image;
+     mappedSize = header.fileSize;
+     writable = true;
+     return attach(mappedSize);
+ }
+
+ bool ThumbnailStore::open(const std::string& path, bool forUpdate) {
+     close();
+     int fd = ::open(path.c_str(), forUpdate ? O_RDWR : O_RDONLY);
+     if (fd < 0) {
+         std::cerr << "Error: Could not open " << path << " for reading." << std::endl;
+         return false;
+     }
+     struct stat st;
+     void* image = MAP_FAILED;
+     if (fstat(fd, &st) == 0 && st.st_size > 0) {
+         image = mmap(nullptr, st.st_size, forUpdate ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+     }
+     ::close(fd);
+     if (image == MAP_FAILED) {
+         std::cerr << "Error: Could not map " << path << "." << std::endl;
+         return false;
+     }
+
+     mappedImage = image;
+     mappedSize = st.st_size;
+     if (!attach(mappedSize)) {
+         std::cerr << "Error: " << path << " is not a valid thumbnail store." << std::endl;
+         close();
+         return false;
+     }
+     ThumbnailHeader* header = static_cast<ThumbnailHeader*>(mappedImage);
+     if (header->complete == 0) {
+         std::cerr << "Warning: " << path << " was not completed (interrupted ingest); it will be rebuilt." << std::endl;
+         close();
+         return false;
+     }
+     if (forUpdate) {
+         // Incomplete again until markComplete(), should this update be interrupted.
+         header->complete = 0;
+         msync(mappedImage, sizeof(ThumbnailHeader), MS_SYNC);
+         writable = true;
+     }
+     return true;
+ }
+
+ bool ThumbnailStore::markComplete() {
+     if (!writable) return false;
+     // Every slot reaches the file before the flag that vouches for it.
+     if (msync(mappedImage, mappedSize, MS_SYNC) != 0) return false;
+     static_cast<ThumbnailHeader*>(mappedImage)->complete = 1;
+     return msync(mappedImage, sizeof(ThumbnailHeader), MS_SYNC) == 0;
+ }
+
+ namespace {
+
+ bool statSource(const std::string& path, SourceStamp& stamp) {
+     struct stat st;
+     if (stat(path.c_str(), &st) != 0) return false;
+     stamp.size = (uint64_t)st.st_size;
+     stamp.mtimeNs = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+     return true;
+ }
+
+ } // namespace
+
+ void ThumbnailStore::setSource(size_t index, const std::string& path) {
+     if (!writable || index >= count) return;
+     SourceStamp stamp;
+     if (statSource(path, stamp)) stamps[index] = stamp;
+ }
+
+ bool ThumbnailStore::isCurrent(size_t index, const std::string& path) const {
+     SourceStamp stamp;
+     if (index >= count || !has(index) || !statSource(path, stamp)) return false;
+     return stamps[index].size == stamp.size && stamps[index].mtimeNs == stamp.mtimeNs;
+ }
+
+ void ThumbnailStore::put(size_t index, const ThumbnailBuilder& builder) {
+     if (!writable || index >= count) return;
+     stamps[index] = SourceStamp(); // Stale until setSource(), should this write be interrupted.
+     builder.finish(pixels + index * slotBytes());
+     originalSizes[index * 2] = (uint32_t)builder.rows();
+     originalSizes[index * 2 + 1] = (uint32_t)builder.cols();
+ }
+
+ void ThumbnailStore::copy(size_t from, size_t to) {
+     if (!writable || from >= count || to >= count || from == to) return;
+     stamps[to] = SourceStamp();
+     std::memcpy(pixels + to * slotBytes(), pixels + from * slotBytes(), slotBytes());
+     originalSizes[to * 2] = originalSizes[from * 2];
+     originalSizes[to * 2 + 1] = originalSizes[from * 2 + 1];
+ }
+
+ std::string ThumbnailStore::name(size_t index) const {
+     return std::string(names + nameOffsets[index], nameOffsets[index + 1] - nameOffsets[index]);
+ }
+
+ cv::Mat ThumbnailStore::thumbnail(size_t index) const {
+     // The header only wraps the mapping; read-only stores must not be written through it.
+     return cv::Mat(side, side, CV_8UC3, pixels + index * slotBytes());
+ }
@@ -0,0 +1,567 @@
+/**
+ * @file VamanaIndex.cpp
+ * @brief Implements the Vamana graph construction, PQ compression and the
+ * on-disk beam search.
+ */
+
+ #include "VamanaIndex.h"
+ #include <algorithm> // for std::sort, std::shuffle, std::upper_bound
+ #include <cerrno>
+ #include <cstdlib>
+ #include <cstring>
+ #include <fstream>
+ #include <memory>
+ #include <numeric>
+ #include <random>
+ #include <unordered_set>
+
+ #include <aio.h>
+ #include <fcntl.h>
+ #include <unistd.h>
+
+ namespace {
+
+ const char VAMANA_MAGIC[4] = {'V', 'M', 'N', 'A'};
+ const uint32_t VAMANA_VERSION = 1;
+ const uint32_t SECTOR_SIZE = 4096;
+ const uint32_t MAX_CENTROIDS = 256; // One byte per PQ code.
+ const uint32_t PQ_TRAINING_SAMPLE = 65536;
+ const int KMEANS_ITERATIONS = 15;
+
+ // Stored in the first sector of the file.
+ struct VamanaHeader {
+     char magic[4];
+     uint32_t version;
+     uint32_t dims;
+     uint32_t maxDegree;
+     uint32_t numDocs;
+     uint32_t medoid;
+     uint32_t numSubspaces;
+     uint32_t numCentroids;
+     uint32_t blockSize;
+     uint32_t nodesPerSector;
+     uint32_t sectorsPerNode;
+     uint32_t reserved;
+     uint64_t pqOffset;
+     uint64_t namesOffset;
+ };
+
+ // A node block is: int32 id, uint32 degree, float features[dims], uint32 neighbors[R].
+ uint32_t blockBytes(int dims, int maxDegree) {
+     return 2 * sizeof(uint32_t) + dims * sizeof(float) + maxDegree * sizeof(uint32_t);
+ }
+
+ float squaredDistance(const float* a, const float* b, int n) {
+     float sum = 0.0f;
+     for (int j = 0; j < n; ++j) {
+         float diff = a[j] - b[j];
+         sum += diff * diff;
+     }
+     return sum;
+ }
+
+ // Greedy best-first search over the in-memory graph used during construction.
+ // Returns every node that was expanded, which is the candidate pool for pruning.
+ std::vector<uint32_t> greedySearch(const std::vector<Document>& docs, const std::vector<std::vector<uint32_t>>& graph,
+                                    uint32_t start, const std::vector<float>& query, int listSize) {
+     std::vector<std::pair<float, uint32_t>> list = {{euclideanDistance(docs[start].features, query), start}};
+     std::unordered_set<uint32_t> seen = {start};
+     std::unordered_set<uint32_t> expanded;
+     std::vector<uint32_t> visited;
+
+     while (true) {
+         auto next = std::find_if(list.begin(), list.end(), [&](const std::pair<float, uint32_t>& c) {
+             return expanded.count(c.second) == 0;
+         });
+         if (next == list.end()) break;
+         uint32_t p = next->second;
+         expanded.insert(p);
+         visited.push_back(p);
+
+         for (uint32_t n : graph[p]) {
+             if (!seen.insert(n).second) continue;
+             std::pair<float, uint32_t> c = {euclideanDistance(docs[n].features, query), n};
+             if ((int)list.size() >= listSize && c.first >= list.back().first) continue;
+             list.insert(std::upper_bound(list.begin(), list.end(), c), c);
+             if ((int)list.size() > listSize) list.pop_back();
+         }
+     }
+     return visited;
+ }
+
+ // Vamana's RobustPrune: keeps the closest candidate, then drops every other
+ // candidate that the kept one already "covers" by a factor of alpha.
+ void robustPrune(const std::vector<Document>& docs, std::vector<std::vector<uint32_t>>& graph, uint32_t p,
+                  std::vector<uint32_t> candidates, float alpha, int maxDegree) {
+     candidates.insert(candidates.end(), graph[p].begin(), graph[p].end());
+     std::sort(candidates.begin(), candidates.end());
+     candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+     std::vector<std::pair<float, uint32_t>> pool;
+     for (uint32_t c : candidates) {
+         if (c != p) pool.push_back({euclideanDistance(docs[p].features, docs[c].features), c});
+     }
+     std::sort(pool.begin(), pool.end());
+
+     graph[p].clear();
+     std::vector<bool> removed(pool.size(), false);
+     for (size_t i = 0; i < pool.size() && (int)graph[p].size() < maxDegree; ++i) {
+         if (removed[i]) continue;
+         uint32_t kept = pool[i].second;
+         graph[p].push_back(kept);
+         for (size_t j = i + 1; j < pool.size(); ++j) {
+             if (!removed[j] && alpha * euclideanDistance(docs[kept].features, docs[pool[j].second].features) <= pool[j].first) {
+                 removed[j] = true;
+             }
+         }
+     }
+ }
+
+ // Plain Lloyd's k-means on n row-major points of width w.
+ std::vector<float> kmeans(const std::vector<float>& points, size_t n, int w, uint32_t k, std::mt19937& gen) {
+     std::vector<size_t> order(n);
+     std::iota(order.begin(), order.end(), 0);
+     std::shuffle(order.begin(), order.end(), gen);
+     std::vector<float> centroids(k * w);
+     for (uint32_t c = 0; c < k; ++c) {
+         std::copy(points.begin() + order[c] * w, points.begin() + (order[c] + 1) * w, centroids.begin() + c * w);
+     }
+
+     std::vector<uint32_t> assignment(n);
+     std::uniform_int_distribution<size_t> anyPoint(0, n - 1);
+     for (int iter = 0; iter < KMEANS_ITERATIONS; ++iter) {
+         for (size_t i = 0; i < n; ++i) {
+             float best = FLT_MAX;
+             for (uint32_t c = 0; c < k; ++c) {
+                 float d = squaredDistance(&points[i * w], &centroids[c * w], w);
+                 if (d < best) { best = d; assignment[i] = c; }
+             }
+         }
+         std::vector<float> sums(k * w, 0.0f);
+         std::vector<uint32_t> counts(k, 0);
+         for (size_t i = 0; i < n; ++i) {
+             counts[assignment[i]]++;
+             for (int j = 0; j < w; ++j) sums[assignment[i] * w + j] += points[i * w + j];
+         }
+         for (uint32_t c = 0; c < k; ++c) {
+             if (counts[c] == 0) {
+                 // Re-seed an empty cluster with a random point.
+                 size_t r = anyPoint(gen);
+                 std::copy(points.begin() + r * w, points.begin() + (r + 1) * w, centroids.begin() + c * w);
+                 continue;
+             }
+             for (int j = 0; j < w; ++j) centroids[c * w + j] = sums[c * w + j] / counts[c];
+         }
+     }
+     return centroids;
+ }
+
+ } // namespace
+
+ //=============================================================================
+ // Construction
+ //=============================================================================
+
+ VamanaIndex::VamanaIndex(int dimensions, int R, int L, float a, int M, unsigned randomSeed)
+     : dims(dimensions), maxDegree(std::max(1, R)), listSize(std::max(1, L)), alpha(a),
+       numSubspaces(std::max(1, std::min(M, dimensions))), seed(randomSeed) {}
+
+ VamanaIndex::~VamanaIndex() {
+     close();
+ }
+
+ void VamanaIndex::close() {
+     if (fd >= 0) ::close(fd);
+     if (metaFd >= 0) ::close(metaFd);
+     fd = metaFd = -1;
+     numDocs = 0;
+ }
+
+ void VamanaIndex::insert(const Document& d) {
+     staged.push_back(d);
+ }
+
+ std::vector<std::vector<uint32_t>> VamanaIndex::buildGraph(uint32_t start) const {
+     uint32_t n = (uint32_t)staged.size();
+     std::mt19937 gen(seed);
+     std::vector<std::vector<uint32_t>> graph(n);
+
+     // Start from a random regular graph.
+     int initialDegree = std::min<int>(maxDegree, n - 1);
+     std::uniform_int_distribution<uint32_t> anyNode(0, n - 1);
+     for (uint32_t i = 0; i < n; ++i) {
+         while ((int)graph[i].size() < initialDegree) {
+             uint32_t j = anyNode(gen);
+             if (j != i && std::find(graph[i].begin(), graph[i].end(), j) == graph[i].end()) graph[i].push_back(j);
+         }
+     }
+
+     // Two refinement passes, first with alpha = 1 and then with the configured alpha.
+     std::vector<uint32_t> order(n);
+     std::iota(order.begin(), order.end(), 0);
+     for (float passAlpha : {1.0f, alpha}) {
+         std::shuffle(order.begin(), order.end(), gen);
+         for (uint32_t p : order) {
+             std::vector<uint32_t> visited = greedySearch(staged, graph, start, staged[p].features, listSize);
+             robustPrune(staged, graph, p, visited, passAlpha, maxDegree);
+
+             // Add the reverse edges, pruning neighbors that overflow.
+             for (uint32_t j : graph[p]) {
+                 if (std::find(graph[j].begin(), graph[j].end(), p) != graph[j].end()) continue;
+                 graph[j].push_back(p);
+                 if ((int)graph[j].size() > maxDegree) {
+                     robustPrune(staged, graph, j, {}, passAlpha, maxDegree);
+                 }
+             }
+         }
+     }
+     return graph;
+ }
+
+ void VamanaIndex::trainQuantizer(std::vector<float>& outCodebooks, std::vector<uint8_t>& outCodes,
+                                  uint32_t& outCentroids) const {
+     size_t n = staged.size();
+     std::mt19937 gen(seed + 1);
+
+     std::vector<size_t> sample(n);
+     std::iota(sample.begin(), sample.end(), 0);
+     if (n > PQ_TRAINING_SAMPLE) {
+         std::shuffle(sample.begin(), sample.end(), gen);
+         sample.resize(PQ_TRAINING_SAMPLE);
+     }
+     outCentroids = std::min<uint32_t>(MAX_CENTROIDS, (uint32_t)sample.size());
+     outCodebooks.assign((size_t)outCentroids * dims, 0.0f);
+     outCodes.assign(n * numSubspaces, 0);
+
+     for (int m = 0; m < numSubspaces; ++m) {
+         int begin = subspaceBegin[m], w = subspaceBegin[m + 1] - begin;
+         std::vector<float> points(sample.size() * w);
+         for (size_t i = 0; i < sample.size(); ++i) {
+             std::copy(staged[sample[i]].features.begin() + begin, staged[sample[i]].features.begin() + begin + w,
+                       points.begin() + i * w);
+         }
+         std::vector<float> centroids = kmeans(points, sample.size(), w, outCentroids, gen);
+         std::copy(centroids.begin(), centroids.end(), outCodebooks.begin() + (size_t)begin * outCentroids);
+
+         for (size_t i = 0; i < n; ++i) {
+             const float* x = staged[i].features.data() + begin;
+             float best = FLT_MAX;
+             for (uint32_t c = 0; c < outCentroids; ++c) {
+                 float d = squaredDistance(x, &centroids[c * w], w);
+                 if (d < best) { best = d; outCodes[i * numSubspaces + m] = (uint8_t)c; }
+             }
+         }
+     }
+ }
+
+ bool VamanaIndex::build(const std::string& path) {
+     if (staged.empty()) return false;
+     close();
+
+     subspaceBegin.resize(numSubspaces + 1);
+     for (int m = 0; m <= numSubspaces; ++m) subspaceBegin[m] = m * dims / numSubspaces;
+
+     // The entry point is the document closest to the centroid of the data.
+     std::vector<float> mean(dims, 0.0f);
+     for (const auto& d : staged) {
+         for (int j = 0; j < dims; ++j) mean[j] += d.features[j] / staged.size();
+     }
+     uint32_t start = 0;
+     float bestDist = FLT_MAX;
+     for (uint32_t i = 0; i < staged.size(); ++i) {
+         float d = euclideanDistance(staged[i].features, mean);
+         if (d < bestDist) { bestDist = d; start = i; }
+     }
+
+     std::vector<std::vector<uint32_t>> graph = buildGraph(start);
+     std::vector<float> cb;
+     std::vector<uint8_t> pqCodes;
+     uint32_t centroids;
+     trainQuantizer(cb, pqCodes, centroids);
+
+     if (!writeIndex(path, graph, start, cb, pqCodes, centroids)) return false;
+     staged.clear();
+     staged.shrink_to_fit();
+     return open(path);
+ }
+
+ bool VamanaIndex::writeIndex(const std::string& path, const std::vector<std::vector<uint32_t>>& graph, uint32_t start,
+                              const std::vector<float>& cb, const std::vector<uint8_t>& pqCodes, uint32_t centroids) const {
+     std::ofstream out(path, std::ios::binary);
+     if (!out.is_open()) {
+         std::cerr << "Error: Could not open " << path << " for writing." << std::endl;
+         return false;
+     }
+
+     uint32_t n = (uint32_t)staged.size();
+     VamanaHeader header;
+     std::memset(&header, 0, sizeof(header));
+     std::memcpy(header.magic, VAMANA_MAGIC, sizeof(header.magic));
+     header.version = VAMANA_VERSION;
+     header.dims = dims;
+     header.maxDegree = maxDegree;
+     header.numDocs = n;
+     header.medoid = start;
+     header.numSubspaces = numSubspaces;
+     header.numCentroids = centroids;
+     header.blockSize = blockBytes(dims, maxDegree);
+     if (header.blockSize <= SECTOR_SIZE) {
+         header.nodesPerSector = SECTOR_SIZE / header.blockSize;
+         header.sectorsPerNode = 1;
+     } else {
+         header.nodesPerSector = 1;
+         header.sectorsPerNode = (header.blockSize + SECTOR_SIZE - 1) / SECTOR_SIZE;
+     }
+     uint64_t nodeGroups = (n + header.nodesPerSector - 1) / header.nodesPerSector;
+     header.pqOffset = (uint64_t)SECTOR_SIZE * (1 + nodeGroups * header.sectorsPerNode);
+     header.namesOffset = header.pqOffset + cb.size() * sizeof(float) + pqCodes.size();
+
+     std::vector<char> sector(SECTOR_SIZE, 0);
+     std::memcpy(sector.data(), &header, sizeof(header));
+     out.write(sector.data(), SECTOR_SIZE);
+
+     // Node blocks, packed into sectors so that no block straddles a sector boundary.
+     std::vector<char> group((size_t)header.sectorsPerNode * SECTOR_SIZE);
+     for (uint64_t g = 0; g < nodeGroups; ++g) {
+         std::fill(group.begin(), group.end(), 0);
+         for (uint32_t slot = 0; slot < header.nodesPerSector; ++slot) {
+             uint64_t i = g * header.nodesPerSector + slot;
+             if (i >= n) break;
+             char* block = group.data() + slot * header.blockSize;
+             int32_t id = staged[i].id;
+             uint32_t degree = (uint32_t)graph[i].size();
+             std::memcpy(block, &id, sizeof(id));
+             std::memcpy(block + 4, &degree, sizeof(degree));
+             std::memcpy(block + 8, staged[i].features.data(), dims * sizeof(float));
+             std::memcpy(block + 8 + dims * sizeof(float), graph[i].data(), degree * sizeof(uint32_t));
+         }
+         out.write(group.data(), group.size());
+     }
+
+     out.write(reinterpret_cast<const char*>(cb.data()), cb.size() * sizeof(float));
+     out.write(reinterpret_cast<const char*>(pqCodes.data()), pqCodes.size());
+
+     uint64_t cursor = 0;
+     for (uint32_t i = 0; i < n; ++i) {
+         out.write(reinterpret_cast<const char*>(&cursor), sizeof(cursor));
+         cursor += staged[i].filename.size();
+     }
+     out.write(reinterpret_cast<const char*>(&cursor), sizeof(cursor));
+     for (uint32_t i = 0; i < n; ++i) out.write(staged[i].filename.data(), staged[i].filename.size());
+     return static_cast<bool>(out);
+ }
+
+ //=============================================================================
+ // Opening an Index
+ //=============================================================================
+
+ bool VamanaIndex::open(const std::string& path) {
+     close();
+     std::ifstream in(path, std::ios::binary);
+     VamanaHeader header;
+     if (!in.is_open() || !in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+         std::memcmp(header.magic, VAMANA_MAGIC, sizeof(header.magic)) != 0 ||
+         header.version != VAMANA_VERSION || (int)header.dims != dims ||
+         header.numSubspaces == 0 || header.numSubspaces > header.dims || header.numCentroids == 0 ||
+         header.numCentroids > MAX_CENTROIDS || header.medoid >= header.numDocs) {
+         std::cerr << "Error: " << path << " is not a valid Vamana index for " << dims << " dimensions." << std::endl;
+         return false;
+     }
+
+     // Searches index node blocks, PQ codes and names straight from these fields,
+     // so the layout must agree with dims and maxDegree and end inside the file.
+     in.seekg(0, std::ios::end);
+     uint64_t size = (uint64_t)in.tellg();
+     uint64_t expectedBlock = 2 * sizeof(uint32_t) + (uint64_t)dims * sizeof(float) + (uint64_t)header.maxDegree * sizeof(uint32_t);
+     bool layoutValid = header.blockSize == expectedBlock && header.nodesPerSector >= 1 && header.sectorsPerNode >= 1 &&
+                        (uint64_t)header.nodesPerSector * header.blockSize <= (uint64_t)header.sectorsPerNode * SECTOR_SIZE;
+     if (layoutValid) {
+         uint64_t nodeGroups = ((uint64_t)header.numDocs + header.nodesPerSector - 1) / header.nodesPerSector;
+         uint64_t nodesEnd = (uint64_t)SECTOR_SIZE * (1 + nodeGroups * header.sectorsPerNode);
+         uint64_t pqBytes = (uint64_t)header.numCentroids * dims * sizeof(float) + (uint64_t)header.numDocs * header.numSubspaces;
+         uint64_t nameTableBytes = ((uint64_t)header.numDocs + 1) * sizeof(uint64_t);
+         layoutValid = nodesEnd <= size && header.pqOffset >= nodesEnd && header.pqOffset <= size &&
+                       pqBytes <= size - header.pqOffset && header.namesOffset >= header.pqOffset + pqBytes &&
+                       header.namesOffset <= size && nameTableBytes <= size - header.namesOffset;
+     }
+     if (!layoutValid) {
+         std::cerr << "Error: " << path << " has an inconsistent node or section layout." << std::endl;
+         return false;
+     }
+     in.clear();
+
+     maxDegree = header.maxDegree;
+     numSubspaces = header.numSubspaces;
+     subspaceBegin.resize(numSubspaces + 1);
+     for (int m = 0; m <= numSubspaces; ++m) subspaceBegin[m] = m * dims / numSubspaces;
+
+     codebooks.resize((size_t)header.numCentroids * dims);
+     codes.resize((size_t)header.numDocs * numSubspaces);
+     in.seekg(header.pqOffset);
+     in.read(reinterpret_cast<char*>(codebooks.data()), codebooks.size() * sizeof(float));
+     in.read(reinterpret_cast<char*>(codes.data()), codes.size());
+     if (!in) {
+         std::cerr << "Error: " << path << " is truncated." << std::endl;
+         return false;
+     }
+
+     // Node reads bypass the page cache when possible; not every file system
+     // supports O_DIRECT, so fall back to buffered reads.
+     fd = ::open(path.c_str(), O_RDONLY | O_DIRECT);
+     if (fd < 0) fd = ::open(path.c_str(), O_RDONLY);
+     metaFd = ::open(path.c_str(), O_RDONLY);
+     if (fd < 0 || metaFd < 0) {
+         std::cerr << "Error: Could not open " << path << " for reading." << std::endl;
+         close();
+         return false;
+     }
+
+     numDocs = header.numDocs;
+     medoid = header.medoid;
+     numCentroids = header.numCentroids;
+     blockSize = header.blockSize;
+     nodesPerSector = header.nodesPerSector;
+     sectorsPerNode = header.sectorsPerNode;
+     namesOffset = header.namesOffset;
+     fileSize = size;
+     return true;
+ }
+
+ uint64_t VamanaIndex::nodeSectorOffset(uint32_t node) const {
+     return (uint64_t)SECTOR_SIZE * (1 + (uint64_t)(node / nodesPerSector) * sectorsPerNode);
+ }
+
+ //=============================================================================
+ // Beam Search
+ //=============================================================================
+
+ std::vector<Document> VamanaIndex::searchSimilar(const Document& query, int k, int beamWidth, int searchL) const {
+     if (fd < 0 || k <= 0) return {};
+     int L = std::max(k, searchL < 0 ? listSize : searchL);
+     int W = std::max(1, beamWidth);
+
+     // Asymmetric distance table: squared distance from each query sub-vector
+     // to every centroid of its subspace.
+     std::vector<float> table((size_t)numSubspaces * numCentroids);
+     for (int m = 0; m < numSubspaces; ++m) {
+         int begin = subspaceBegin[m], w = subspaceBegin[m + 1] - begin;
+         const float* cb = codebooks.data() + (size_t)begin * numCentroids;
+         for (uint32_t c = 0; c < numCentroids; ++c) {
+             table[m * numCentroids + c] = squaredDistance(query.features.data() + begin, cb + c * w, w);
+         }
+     }
+     auto pqDistance = [&](uint32_t node) {
+         const uint8_t* code = codes.data() + (size_t)node * numSubspaces;
+         float sum = 0.0f;
+         for (int m = 0; m < numSubspaces; ++m) sum += table[m * numCentroids + code[m]];
+         return sum;
+     };
+
+     struct Candidate { float dist; uint32_t node; bool expanded; };
+     std::vector<Candidate> list = {{pqDistance(medoid), medoid, false}};
+     std::unordered_set<uint32_t> seen = {medoid};
+
+     struct Exact { float dist; uint32_t node; int32_t id; std::vector<float> features; };
+     std::vector<Exact> exact;
+
+     size_t readBytes = (size_t)sectorsPerNode * SECTOR_SIZE;
+     void* raw = nullptr;
+     if (posix_memalign(&raw, SECTOR_SIZE, readBytes * W) != 0) return {};
+     std::unique_ptr<char, decltype(&std::free)> buffers(static_cast<char*>(raw), &std::free);
+     std::vector<aiocb> requests(W);
+
+     auto expand = [&](uint32_t node, const char* sectorData) {
+         const char* block = sectorData + (node % nodesPerSector) * blockSize;
+         Exact e;
+         e.node = node;
+         uint32_t degree;
+         std::memcpy(&e.id, block, sizeof(e.id));
+         std::memcpy(&degree, block + 4, sizeof(degree));
+         e.features.resize(dims);
+         std::memcpy(e.features.data(), block + 8, dims * sizeof(float));
+         e.dist = euclideanDistance(query.features, e.features);
+         const char* neighbors = block + 8 + dims * sizeof(float);
+         for (uint32_t i = 0; i < std::min<uint32_t>(degree, maxDegree); ++i) {
+             uint32_t nb;
+             std::memcpy(&nb, neighbors + i * sizeof(uint32_t), sizeof(nb));
+             if (nb >= numDocs || !seen.insert(nb).second) continue;
+             Candidate c = {pqDistance(nb), nb, false};
+             if ((int)list.size() >= L && c.dist >= list.back().dist) continue;
+             auto pos = std::upper_bound(list.begin(), list.end(), c, [](const Candidate& a, const Candidate& b) {
+                 return a.dist < b.dist;
+             });
+             list.insert(pos, c);
+             if ((int)list.size() > L) list.pop_back();
+         }
+         exact.push_back(std::move(e));
+     };
+
+     while (true) {
+         // The beam: the W closest candidates (by PQ distance) not yet expanded.
+         std::vector<uint32_t> beam;
+         for (auto& c : list) {
+             if (c.expanded) continue;
+             c.expanded = true;
+             beam.push_back(c.node);
+             if ((int)beam.size() == W) break;
+         }
+         if (beam.empty()) break;
+
+         // Issue all sector reads of the beam at once, then process each one as it completes.
+         std::vector<int> pending;
+         for (size_t b = 0; b < beam.size(); ++b) {
+             aiocb& r = requests[b];
+             std::memset(&r, 0, sizeof(r));
+             r.aio_fildes = fd;
+             r.aio_buf = buffers.get() + b * readBytes;
+             r.aio_nbytes = readBytes;
+             r.aio_offset = nodeSectorOffset(beam[b]);
+             if (aio_read(&r) == 0) {
+                 pending.push_back((int)b);
+             } else if (pread(fd, buffers.get() + b * readBytes, readBytes, r.aio_offset) == (ssize_t)readBytes) {
+                 expand(beam[b], buffers.get() + b * readBytes);
+             }
+         }
+         while (!pending.empty()) {
+             std::vector<const aiocb*> waitList;
+             for (int b : pending) waitList.push_back(&requests[b]);
+             aio_suspend(waitList.data(), (int)waitList.size(), nullptr);
+
+             std::vector<int> stillPending;
+             for (int b : pending) {
+                 int status = aio_error(&requests[b]);
+                 if (status == EINPROGRESS) {
+                     stillPending.push_back(b);
+                     continue;
+                 }
+                 if (status == 0 && aio_return(&requests[b]) == (ssize_t)readBytes) {
+                     expand(beam[b], buffers.get() + b * readBytes);
+                 } else {
+                     aio_return(&requests[b]);
+                     std::cerr << "Error: Failed to read node " << beam[b] << " from the Vamana index." << std::endl;
+                 }
+             }
+             pending.swap(stillPending);
+         }
+     }
+
+     // Re-rank every expanded node by its exact distance.
+     int result_count = std::min(k, (int)exact.size());
+     std::partial_sort(exact.begin(), exact.begin() + result_count, exact.end(), [](const Exact& a, const Exact& b) {
+         return a.dist < b.dist;
+     });
+
+     std::vector<Document> results;
+     for (int i = 0; i < result_count; ++i) {
+         uint64_t range[2] = {0, 0};
+         std::string name;
+         uint64_t namesData = namesOffset + (uint64_t)(numDocs + 1) * sizeof(uint64_t);
+         if (pread(metaFd, range, sizeof(range), namesOffset + exact[i].node * sizeof(uint64_t)) == sizeof(range) &&
+             range[0] <= range[1] && range[1] <= fileSize - namesData) {
+             name.resize(range[1] - range[0]);
+             if (pread(metaFd, &name[0], name.size(), namesData + range[0]) != (ssize_t)name.size()) name.clear();
+         }
+         results.emplace_back(exact[i].id, std::move(exact[i].features), std::move(name));
+     }
+     return results;
+ }
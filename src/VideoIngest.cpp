@@ -0,0 +1,66 @@
+/**
+ * @file VideoIngest.cpp
+ * @brief Implements frame sampling and scene-change detection for video files.
+ */
+
+ #include "VideoIngest.h"
+ #include <algorithm> // for std::max, std::transform
+ #include <cctype>
+ #include <cstdio>
+
+ VideoIngestor::VideoIngestor(int step, float threshold) : frameStep(std::max(1, step)), sceneThreshold(threshold) {}
+
+ bool VideoIngestor::ingest(const std::string& path, std::vector<VideoKeyframe>& keyframes, int* sampledFrames) {
+     if (sampledFrames != nullptr) *sampledFrames = 0;
+     if (!capture.open(path) || !capture.isOpened()) {
+         std::cerr << "Error: Could not open the video at: " << path << std::endl;
+         return false;
+     }
+     double fps = capture.get(cv::CAP_PROP_FPS);
+
+     std::vector<float> histogram(HISTOGRAM_SIZE);
+     const VideoKeyframe* last = nullptr;
+     size_t firstKeyframe = keyframes.size();
+     for (int index = 0; capture.grab(); ++index) {
+         // Frames between samples are grabbed but never converted to BGR.
+         if (index % frameStep != 0) continue;
+         if (!capture.retrieve(frame) || frame.empty()) continue;
+         if (sampledFrames != nullptr) ++*sampledFrames;
+
+         // The integral histogram yields the exact full-frame histogram, as in HistogramExtractor.
+         IntegralHistogram integral;
+         integral.build(frame);
+         integral.histogram(histogram.data());
+         if (last != nullptr && euclideanDistance(histogram, last->features) < sceneThreshold) continue;
+
+         VideoKeyframe keyframe;
+         keyframe.frameIndex = index;
+         double ms = capture.get(cv::CAP_PROP_POS_MSEC);
+         keyframe.timestamp = (ms <= 0.0 && index > 0 && fps > 0.0) ? index / fps : ms / 1000.0;
+         keyframe.features = histogram;
+         keyframe.perceptualHash = computeDHash(frame);
+         keyframe.integral = std::move(integral);
+         keyframes.push_back(std::move(keyframe));
+         last = &keyframes.back();
+     }
+     capture.release();
+
+     if (keyframes.size() == firstKeyframe) {
+         std::cerr << "Warning: No frames could be decoded from: " << path << std::endl;
+     }
+     return true;
+ }
+
+ bool isVideoFile(const std::string& path) {
+     size_t dot = path.find_last_of('.');
+     if (dot == std::string::npos) return false;
+     std::string extension = path.substr(dot);
+     std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+     return extension == ".mp4" || extension == ".avi" || extension == ".mkv" || extension == ".mov" || extension == ".webm";
+ }
+
+ std::string videoFrameName(const std::string& path, double timestamp) {
+     char fragment[32];
+     std::snprintf(fragment, sizeof(fragment), "#t=%.3f", timestamp);
+     return path + fragment;
+ }
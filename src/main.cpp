@@ -7,14 +7,51 @@
 
  #include "ImageUtils.h"
  #include "DataStructures.h"
+ #include "CoverTree.h"
+ #include "CompactKdTree.h"
+ #include "DualTree.h"
+ #include "RandomProjectionForest.h"
+ #include "VamanaIndex.h"
+ #include "BKTree.h"
+ #include "StreamingDecoder.h"
+ #include "ThumbnailStore.h"
+ #include "DirectoryWatcher.h"
+ #include "LiveIndex.h"
+ #include "VideoIngest.h"
+ #include "QuadraticForm.h"
+ #include "ItqIndex.h"
+ #include "HugePages.h"
  #include <chrono>
+ #include <csignal>
  #include <filesystem>
  #include <fstream>
+ #include <functional>
  #include <algorithm>
+ #include <atomic>
+ #include <thread>
  #include <vector>
  
  namespace fs = std::filesystem;
  
+ // Images whose decoded BGR bitmap would exceed 128 MB (about 44 megapixels) are
+ // decoded band by band. The size comes from the JPEG/PNG header: the compressed
+ // size says little about it, as a flat 100-megapixel scan can be a few MB.
+ const uint64_t STREAMING_PIXEL_BUDGET = 128ull << 20;
+
+ bool exceedsPixelBudget(const std::string& path) {
+     int rows = 0, cols = 0;
+     return StreamingExtractor::readImageSize(path, rows, cols) && (uint64_t)rows * cols * 3 > STREAMING_PIXEL_BUDGET;
+ }
+ 
+ // Set by Ctrl+C to leave the watch mode cleanly.
+ volatile std::sig_atomic_t stop_requested = 0;
+ void requestStop(int) { stop_requested = 1; }
+ 
+ bool isImageFile(const fs::path& p) {
+     std::string extension = p.extension().string();
+     return extension == ".jpg" || extension == ".jpeg" || extension == ".png";
+ }
+ 
  // Helper function to get the category from a filename (e.g., "data/150.jpg" -> category 1)
  // It assumes images are grouped in hundreds.
  int getCategory(const std::string& filename) {
@@ -28,24 +65,161 @@
      }
  }
  
- int main() {
+ // Extracts the histogram of a single file, streaming it if it is very large.
+ bool extractFeatures(const std::string& path, HistogramExtractor& extractor, StreamingExtractor& streamer, float* out) {
+     if (exceedsPixelBudget(path)) {
+         StreamStatus status = streamer.extractFile(path, out);
+         if (status != StreamStatus::Unsupported) return status == StreamStatus::Extracted;
+     }
+     return extractor.extractFile(path, out);
+ }
+ 
+ // Watch mode: keeps a live index in sync with the watched directory until Ctrl+C.
+ // Each batch of changes is extracted in parallel and applied in place, so a change
+ // is searchable at most WATCH_BATCH_MS plus its extraction time after it happened.
+ int watchDirectory(DirectoryWatcher& watcher, const std::vector<Document>& docs, int dimensions, unsigned seed) {
+     const int WATCH_IDLE_MS = 500;  // How often the stop flag is checked while nothing changes.
+     const int WATCH_BATCH_MS = 200; // How long a burst of changes is coalesced before it is applied.
+ 
+     LiveIndex live(dimensions, 1, seed); // Ids continue the numbering of the initial documents.
+     for (const auto& doc : docs) live.insertOrReplace(doc.filename, doc.features);
+ 
+     std::signal(SIGINT, requestStop);
+     std::signal(SIGTERM, requestStop);
+     std::cout << "Watching for changes (" << live.size() << " documents indexed). Press Ctrl+C to stop." << std::endl;
+ 
+     unsigned num_workers = std::max(1u, std::thread::hardware_concurrency());
+     while (!stop_requested) {
+         std::vector<FileEvent> events = watcher.poll(WATCH_IDLE_MS, WATCH_BATCH_MS);
+         events.erase(std::remove_if(events.begin(), events.end(), [](const FileEvent& e) {
+             return !isImageFile(e.path);
+         }), events.end());
+         if (events.empty()) continue;
+ 
+         auto start_time = std::chrono::high_resolution_clock::now();
+         std::vector<std::vector<float>> features(events.size());
+         std::vector<char> extracted(events.size(), 0);
+         std::atomic<size_t> next_event(0);
+         auto extraction_worker = [&]() {
+             HistogramExtractor extractor;
+             StreamingExtractor streamer;
+             for (size_t i = next_event++; i < events.size(); i = next_event++) {
+                 if (events[i].type != FileEvent::Type::Changed) continue;
+                 features[i].resize(dimensions);
+                 extracted[i] = extractFeatures(events[i].path, extractor, streamer, features[i].data());
+             }
+         };
+         std::vector<std::thread> workers;
+         for (unsigned i = 1; i < std::min<size_t>(num_workers, events.size()); ++i) workers.emplace_back(extraction_worker);
+         extraction_worker();
+         for (auto& worker : workers) worker.join();
+ 
+         // A file that can no longer be decoded leaves the index, like a deleted one.
+         size_t added = 0, updated = 0, removed = 0;
+         for (size_t i = 0; i < events.size(); ++i) {
+             if (!extracted[i]) {
+                 if (live.remove(events[i].path)) removed++;
+             } else {
+                 (live.contains(events[i].path) ? updated : added)++;
+                 live.insertOrReplace(events[i].path, features[i]);
+             }
+         }
+         auto end_time = std::chrono::high_resolution_clock::now();
+         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+ 
+         std::cout << "[watch] +" << added << " ~" << updated << " -" << removed << " | documents: " << live.size()
+                   << " | applied in " << duration.count() << " ms" << std::endl;
+         for (size_t i = 0; i < events.size(); ++i) {
+             if (!extracted[i]) continue;
+             Document query(0, features[i], events[i].path);
+             for (const auto& res : live.searchSimilar(query, 2)) {
+                 if (res.filename == query.filename) continue;
+                 std::cout << "  " << query.filename << " -> nearest: " << res.filename << std::endl;
+                 break;
+             }
+         }
+     }
+     std::cout << "Watch mode stopped." << std::endl;
+     return 0;
+ }
+ 
+ int main(int argc, char* argv[]) {
      //=========================================================================
      // 1. DATA CONFIGURATION AND LOADING
      //=========================================================================
      
-     // --- Automatically load all image paths from the "data" directory ---
+     // --- Seed of every randomized structure; pass a number to override it ---
+     // --- "--thumbnails <file>" keeps a thumbnail store next to the dataset ---
+     // --- "--watch" keeps indexing changes to the dataset instead of running the experiments ---
+     // --- "--huge-pages <system|standard|thp|explicit>" backs the large arrays with that page size ---
+     // --- "--page-benchmark" adds the page size comparison on a corpus larger than the cache ---
+     // --- "--layout-benchmark" adds the kd-tree node layout comparison across corpus sizes ---
+     // --- "--region-queries" keeps an integral histogram (~28 KB) per image for the region query experiment ---
+     // Example: ./meu_programa 1234 --thumbnails thumbnails.bin --huge-pages thp --region-queries
+     unsigned seed = DEFAULT_RANDOM_SEED;
+     std::string thumbnail_path;
+     bool watch_mode = false;
+     bool page_benchmark = false;
+     bool layout_benchmark = false;
+     bool region_queries = false;
+     for (int a = 1; a < argc; ++a) {
+         std::string arg = argv[a];
+         if (arg == "--thumbnails" && a + 1 < argc) {
+             thumbnail_path = argv[++a];
+             continue;
+         }
+         if (arg == "--huge-pages" && a + 1 < argc) {
+             PagePolicy policy;
+             if (!parsePagePolicy(argv[++a], policy)) {
+                 std::cerr << "Error: --huge-pages expects system, standard, thp or explicit." << std::endl;
+                 return 1;
+             }
+             setPagePolicy(policy);
+             continue;
+         }
+         if (arg == "--page-benchmark") {
+             page_benchmark = true;
+             continue;
+         }
+         if (arg == "--layout-benchmark") {
+             layout_benchmark = true;
+             continue;
+         }
+         if (arg == "--region-queries") {
+             region_queries = true;
+             continue;
+         }
+         if (arg == "--watch") {
+             watch_mode = true;
+             continue;
+         }
+         try {
+             seed = (unsigned)std::stoul(arg);
+         } catch (...) {
+             std::cerr << "Error: Invalid argument '" << arg << "'." << std::endl;
+             return 1;
+         }
+     }
+ 
+     // --- Automatically load all image (and video) paths from the "data" directory ---
      std::vector<std::string> image_paths;
+     std::vector<std::string> video_paths;
      const std::string data_path = "data";
+     // In watch mode, changes made during the initial load are queued rather than missed.
+     DirectoryWatcher watcher;
+     if (watch_mode && !watcher.start(data_path)) return 1;
      for (const auto & entry : fs::directory_iterator(data_path)) {
-         if (entry.is_regular_file()) {
-             std::string extension = entry.path().extension().string();
-             if (extension == ".jpg" || extension == ".jpeg" || extension == ".png") {
-                 image_paths.push_back(entry.path().string());
-             }
+         if (entry.is_regular_file() && isImageFile(entry.path())) {
+             image_paths.push_back(entry.path().string());
+         } else if (entry.is_regular_file() && !watch_mode && isVideoFile(entry.path().string())) {
+             video_paths.push_back(entry.path().string());
          }
      }
+     // The directory order is unspecified; sort it so document ids are stable across runs.
+     std::sort(image_paths.begin(), image_paths.end());
+     std::sort(video_paths.begin(), video_paths.end());
  
-     if (image_paths.empty()) {
+     if (image_paths.empty() && video_paths.empty() && !watch_mode) {
          std::cerr << "Error: No images found in the 'data' directory." << std::endl;
          return 1;
      }
@@ -73,32 +247,203 @@
      std::cout << "Results will be saved to results.txt" << std::endl;
      resultsFile << "PERFORMANCE AND PRECISION ANALYSIS (Flat Directory Dataset)\n";
      resultsFile << "================================================================\n";
-     resultsFile << "Total images in database: " << image_paths.size() << "\n\n";
+     resultsFile << "Total images in database: " << image_paths.size() << "\n";
+     resultsFile << "Random seed: " << seed << "\n";
+ 
+     const int FEATURE_DIMENSIONS = HISTOGRAM_SIZE;
+     const int TOP_K = 10;
+     const int NEAR_DUPLICATE_BITS = 6; // Max. dHash Hamming distance of a near-duplicate.
  
      // --- Load all documents into memory once to be fair in timing ---
-     std::cout << "Loading and extracting features from " << image_paths.size() << " images..." << std::endl;
+     // Each worker owns one HistogramExtractor and writes straight into its rows
+     // of the preallocated feature matrix. Files whose bytes were already seen are
+     // not decoded; they are linked to the row of the first copy instead.
+     // Very large images are streamed from disk so no worker holds a whole bitmap;
+     // they skip the duplicate check, which would need the whole file in memory.
+     // With a thumbnail store, the first run also fills it; once it matches the
+     // dataset, later runs recompute the features from it without decoding, except
+     // for files whose size or modification time changed, which are decoded again
+     // and refreshed in the store. A store whose ingest never finished is rebuilt.
+     // One run never mixes feature definitions: when the store is reused, every
+     // document's features come from its thumbnail, including the refreshed ones;
+     // when it is (re)built, all come from the full-resolution pixels.
+     ThumbnailStore thumbnails;
+     bool from_thumbnails = false;
+     if (!thumbnail_path.empty()) {
+         if (fs::exists(thumbnail_path) && thumbnails.open(thumbnail_path, true) && thumbnails.size() == image_paths.size()) {
+             from_thumbnails = true;
+             for (size_t i = 0; i < image_paths.size() && from_thumbnails; ++i) from_thumbnails = thumbnails.name(i) == image_paths[i];
+         }
+         if (!from_thumbnails) thumbnails.create(thumbnail_path, image_paths);
+     }
+     std::cout << "Loading and extracting features from " << image_paths.size() << " images"
+               << (from_thumbnails ? " (from thumbnails)..." : "...") << std::endl;
+     std::vector<float> feature_matrix(image_paths.size() * FEATURE_DIMENSIONS);
+     std::vector<char> extracted(image_paths.size(), 0);
+     std::vector<size_t> feature_row(image_paths.size());
+     std::vector<uint64_t> perceptual_hash(image_paths.size(), 0);
+     // For region queries without re-decoding; empty unless they were requested.
+     std::vector<IntegralHistogram> integrals(region_queries ? image_paths.size() : 0);
+     ContentHashMap content_hashes;
+     std::atomic<size_t> next_image(0);
+     auto extraction_worker = [&]() {
+         HistogramExtractor extractor;
+         StreamingExtractor streamer;
+         ThumbnailBuilder thumbnail;
+         ThumbnailBuilder* thumbnail_out = thumbnails.isWritable() ? &thumbnail : nullptr;
+         for (size_t i = next_image++; i < image_paths.size(); i = next_image++) {
+             feature_row[i] = i;
+             IntegralHistogram* integral_out = region_queries ? &integrals[i] : nullptr;
+             auto from_thumbnail = [&]() {
+                 cv::Mat pixels = thumbnails.thumbnail(i);
+                 computeHistogram(pixels, &feature_matrix[i * FEATURE_DIMENSIONS]);
+                 perceptual_hash[i] = computeDHash(pixels);
+                 if (integral_out) integral_out->build(pixels);
+                 extracted[i] = 1;
+             };
+             if (from_thumbnails && thumbnails.isCurrent(i, image_paths[i])) {
+                 from_thumbnail();
+                 continue;
+             }
+             if (exceedsPixelBudget(image_paths[i])) {
+                 StreamStatus status = streamer.extractFile(image_paths[i], &feature_matrix[i * FEATURE_DIMENSIONS],
+                                                            &perceptual_hash[i], integral_out, thumbnail_out,
+                                                            thumbnails.thumbnailSide());
+                 if (status == StreamStatus::Failed) continue;
+                 if (status == StreamStatus::Extracted) {
+                     extracted[i] = 1;
+                     if (thumbnail_out) {
+                         thumbnails.put(i, thumbnail);
+                         thumbnails.setSource(i, image_paths[i]);
+                         if (from_thumbnails) from_thumbnail(); // Same definition as the current slots.
+                     }
+                     continue;
+                 }
+             }
+             if (!extractor.readFile(image_paths[i])) continue;
+             feature_row[i] = content_hashes.findOrInsert(extractor.bufferHash(), extractor.bufferSize(), i);
+             if (feature_row[i] != i) continue; // Duplicate: resolved after all workers finish.
+             extracted[i] = extractor.extract(extractor.buffer(), extractor.bufferSize(),
+                                              &feature_matrix[i * FEATURE_DIMENSIONS], &perceptual_hash[i], integral_out);
+             if (!extracted[i]) {
+                 std::cerr << "Error: Could not decode the image at: " << image_paths[i] << std::endl;
+             } else if (thumbnail_out) {
+                 const cv::Mat& pixels = extractor.image();
+                 thumbnail.begin(pixels.rows, pixels.cols, thumbnails.thumbnailSide());
+                 thumbnail.addRows(pixels, 0);
+                 thumbnails.put(i, thumbnail);
+                 thumbnails.setSource(i, image_paths[i]);
+                 if (from_thumbnails) from_thumbnail(); // Same definition as the current slots.
+             }
+         }
+     };
+     unsigned num_workers = std::max(1u, std::thread::hardware_concurrency());
+     std::vector<std::thread> workers;
+     for (unsigned i = 1; i < num_workers; ++i) workers.emplace_back(extraction_worker);
+     extraction_worker();
+     for (auto& worker : workers) worker.join();
+     if (thumbnails.isWritable()) {
+         for (size_t i = 0; i < image_paths.size(); ++i) {
+             if (feature_row[i] == i || !extracted[feature_row[i]]) continue;
+             thumbnails.copy(feature_row[i], i);
+             thumbnails.setSource(i, image_paths[i]);
+         }
+         // Only now does a later run trust the store.
+         if (!thumbnails.markComplete()) std::cerr << "Warning: Could not finalize " << thumbnail_path << "." << std::endl;
+     }
+     thumbnails.close();
+ 
      std::vector<Document> all_docs;
+     std::vector<uint64_t> all_hashes; // Perceptual hash of each document in all_docs.
+     std::vector<size_t> all_rows;     // Row of each document in all_docs in the feature matrix and integrals.
      int id_counter = 1;
-     for (const auto &path : image_paths) {
-         std::vector<float> features = extractHistogram(path);
-         if (!features.empty()) {
-             all_docs.emplace_back(id_counter++, features, path);
+     size_t duplicate_files = 0;
+     for (size_t i = 0; i < image_paths.size(); ++i) {
+         size_t row_index = feature_row[i];
+         if (row_index != i) duplicate_files++;
+         if (extracted[row_index]) {
+             const float* row = &feature_matrix[row_index * FEATURE_DIMENSIONS];
+             all_docs.emplace_back(id_counter++, std::vector<float>(row, row + FEATURE_DIMENSIONS), image_paths[i]);
+             all_hashes.push_back(perceptual_hash[row_index]);
+             all_rows.push_back(row_index);
          }
      }
-     std::cout << "Feature extraction complete.\n" << std::endl;
+     std::cout << "Feature extraction complete. Duplicate files (decodes saved): " << duplicate_files << "\n" << std::endl;
+     resultsFile << "Duplicate files (decodes saved): " << duplicate_files << "\n";
  
-     const int FEATURE_DIMENSIONS = 24;
-     const int TOP_K = 10;
+     // --- Video keyframes become documents named "<video>#t=<seconds>" ---
+     // Each worker decodes whole videos; results are appended in path order so ids stay stable.
+     std::vector<std::vector<VideoKeyframe>> video_keyframes(video_paths.size());
+     std::vector<int> video_sampled(video_paths.size(), 0);
+     std::atomic<size_t> next_video(0);
+     auto video_worker = [&]() {
+         VideoIngestor ingestor;
+         for (size_t v = next_video++; v < video_paths.size(); v = next_video++) {
+             ingestor.ingest(video_paths[v], video_keyframes[v], &video_sampled[v]);
+         }
+     };
+     workers.clear();
+     for (unsigned i = 1; i < std::min<size_t>(num_workers, video_paths.size()); ++i) workers.emplace_back(video_worker);
+     video_worker();
+     for (auto& worker : workers) worker.join();
+ 
+     size_t sampled_frames = 0, keyframe_count = 0;
+     for (size_t v = 0; v < video_paths.size(); ++v) {
+         sampled_frames += video_sampled[v];
+         for (auto& keyframe : video_keyframes[v]) {
+             all_docs.emplace_back(id_counter++, std::move(keyframe.features), videoFrameName(video_paths[v], keyframe.timestamp));
+             all_hashes.push_back(keyframe.perceptualHash);
+             all_rows.push_back(integrals.size());
+             if (region_queries) integrals.push_back(std::move(keyframe.integral));
+             keyframe_count++;
+         }
+     }
+     video_keyframes.clear();
+     if (!video_paths.empty()) {
+         std::cout << "Video ingestion complete. Keyframes kept: " << keyframe_count << " of " << sampled_frames
+                   << " sampled frames from " << video_paths.size() << " videos.\n" << std::endl;
+     }
+     resultsFile << "Videos: " << video_paths.size() << " | Keyframes indexed: " << keyframe_count
+                 << " (of " << sampled_frames << " sampled frames)\n\n";
+ 
+     if (watch_mode) return watchDirectory(watcher, all_docs, FEATURE_DIMENSIONS, seed);
+ 
+     // --- Per-channel cumulative histograms, for the Earth Mover's Distance experiments ---
+     std::vector<Document> cdf_docs; // Parallel to all_docs.
+     cdf_docs.reserve(all_docs.size());
+     for (const auto& doc : all_docs) {
+         cdf_docs.emplace_back(doc.id, std::vector<float>(FEATURE_DIMENSIONS), doc.filename);
+         histogramToCdf(doc.features.data(), cdf_docs.back().features.data());
+     }
+ 
+     // --- Features transformed so the quadratic-form (cross-bin) distance becomes Euclidean ---
+     QuadraticFormTransform quadratic_form;
+     std::vector<Document> qf_docs; // Parallel to all_docs; empty if the factorization fails.
+     if (quadratic_form.factorize(QuadraticFormTransform::binSimilarity(), FEATURE_DIMENSIONS)) {
+         qf_docs.reserve(all_docs.size());
+         for (const auto& doc : all_docs) {
+             qf_docs.emplace_back(doc.id, std::vector<float>(FEATURE_DIMENSIONS), doc.filename);
+             quadratic_form.apply(doc.features.data(), qf_docs.back().features.data());
+         }
+     }
  
      //=========================================================================
      // 2. EXPERIMENTS LOOP
      //=========================================================================
      for (const auto& query_path : query_paths) {
          Document query;
+         Document cdf_query;
+         Document qf_query;
+         uint64_t query_hash = 0;
+         size_t query_row = 0;
          bool query_found = false;
-         for(const auto& doc : all_docs){
-             if(doc.filename == query_path){
-                 query = doc;
+         for(size_t i = 0; i < all_docs.size(); ++i){
+             if(all_docs[i].filename == query_path){
+                 query = all_docs[i];
+                 cdf_query = cdf_docs[i];
+                 if (!qf_docs.empty()) qf_query = qf_docs[i];
+                 query_hash = all_hashes[i];
+                 query_row = all_rows[i];
                  query_found = true;
                  break;
              }
@@ -112,6 +457,26 @@
          resultsFile << "--------------------------------------\n";
          resultsFile << "QUERY IMAGE: " << query.filename << " (Category " << queryCategory << ")\n";
          resultsFile << "--------------------------------------\n\n";
+ 
+         // --- Experiment 0: Perceptual Hash Prefilter (BK-tree) ---
+         // Near-exact duplicates are answered from the dHash alone, before any histogram search.
+         {
+             BKTree bk;
+             for(size_t i = 0; i < all_docs.size(); ++i) { if(all_docs[i].filename != query.filename) bk.insert(all_hashes[i], all_docs[i]); }
+ 
+             auto start_time = std::chrono::high_resolution_clock::now();
+             std::vector<Document> duplicates = bk.searchWithin(query_hash, NEAR_DUPLICATE_BITS);
+             auto end_time = std::chrono::high_resolution_clock::now();
+             auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
+ 
+             resultsFile << "--- Method: Perceptual Hash Prefilter (BK-tree) ---\n";
+             resultsFile << "Time: " << duration.count() << " us\n";
+             resultsFile << "Near-duplicates within " << NEAR_DUPLICATE_BITS << " bits: " << duplicates.size() << "\n";
+             for(const auto& dup : duplicates){
+                 resultsFile << "  " << dup.filename << "\n";
+             }
+             resultsFile << "\n";
+         }
          
          // --- Experiment 1: Sequential List ---
          {
@@ -155,7 +520,7 @@
  
          // --- Experiment 3: Locality-Sensitive Hashing (LSH) ---
          {
-             DocumentHash lsh(FEATURE_DIMENSIONS, 16, 0.5); 
+             DocumentHash lsh(FEATURE_DIMENSIONS, 16, 0.5, HashFamily::GaussianProjection, seed);
              for(const auto& doc : all_docs) { if(doc.filename != query.filename) lsh.insert(doc); }
  
              auto start_time = std::chrono::high_resolution_clock::now();
@@ -177,6 +542,487 @@
                  resultsFile << "Precision@" << results.size() << " (on returned items): " << precision << "%\n\n";
              }
          }
+
+         // --- Experiment 4: Cover Tree ---
+         {
+             CoverTree coverTree;
+             for(const auto& doc : all_docs) { if(doc.filename != query.filename) coverTree.insert(doc); }
+
+             auto start_time = std::chrono::high_resolution_clock::now();
+             std::vector<Document> results = coverTree.searchSimilar(query, TOP_K);
+             auto end_time = std::chrono::high_resolution_clock::now();
+             auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
+
+             int correct_count = 0;
+             resultsFile << "--- Method: Cover Tree ---\n";
+             resultsFile << "Time: " << duration.count() << " us\n";
+             for(const auto& res : results){
+                 if(getCategory(res.filename) == queryCategory) correct_count++;
+             }
+             double precision = (double)correct_count / TOP_K * 100.0;
+             resultsFile << "Precision@" << TOP_K << ": " << precision << "%\n\n";
+         }
+
+         // --- Experiment 5: Random Projection Forest ---
+         {
+             RPForest forest(FEATURE_DIMENSIONS, 10, 16, seed);
+             for(const auto& doc : all_docs) { if(doc.filename != query.filename) forest.insert(doc); }
+             if (!forest.build()) return 1;
+
+             auto start_time = std::chrono::high_resolution_clock::now();
+             std::vector<Document> results = forest.searchSimilar(query, TOP_K);
+             auto end_time = std::chrono::high_resolution_clock::now();
+             auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
+
+             int correct_count = 0;
+             resultsFile << "--- Method: Random Projection Forest ---\n";
+             resultsFile << "Time: " << duration.count() << " us\n";
+             for(const auto& res : results){
+                 if(getCategory(res.filename) == queryCategory) correct_count++;
+             }
+             double precision = (double)correct_count / TOP_K * 100.0;
+             resultsFile << "Precision@" << TOP_K << ": " << precision << "%\n\n";
+         }
+
+         // --- Experiment 6: Vamana Graph (disk-resident vectors) ---
+         {
+             VamanaIndex vamana(FEATURE_DIMENSIONS, 32, 64, 1.2f, 8, seed);
+             for(const auto& doc : all_docs) { if(doc.filename != query.filename) vamana.insert(doc); }
+             if(!vamana.build("vamana.idx")){
+                 std::cerr << "Warning: Could not build the Vamana index. Skipping." << std::endl;
+             } else {
+                 auto start_time = std::chrono::high_resolution_clock::now();
+                 std::vector<Document> results = vamana.searchSimilar(query, TOP_K);
+                 auto end_time = std::chrono::high_resolution_clock::now();
+                 auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
+
+                 int correct_count = 0;
+                 resultsFile << "--- Method: Vamana Graph (disk) ---\n";
+                 resultsFile << "Time: " << duration.count() << " us\n";
+                 for(const auto& res : results){
+                     if(getCategory(res.filename) == queryCategory) correct_count++;
+                 }
+                 double precision = (double)correct_count / TOP_K * 100.0;
+                 resultsFile << "Precision@" << TOP_K << ": " << precision << "%\n\n";
+             }
+         }
+
+         // --- Experiment 7: Region Query (center of the query image, K-d Tree; only with --region-queries) ---
+         // The region histogram comes from the stored integral histogram, not from the image file.
+         if (region_queries) {
+             KdTree tree(FEATURE_DIMENSIONS);
+             for(const auto& doc : all_docs) { if(doc.filename != query.filename) tree.insert(doc); }
+ 
+             const IntegralHistogram& integral = integrals[query_row];
+             cv::Rect center(integral.cols() / 4, integral.rows() / 4, integral.cols() / 2, integral.rows() / 2);
+ 
+             auto start_time = std::chrono::high_resolution_clock::now();
+             Document region_query(query.id, std::vector<float>(FEATURE_DIMENSIONS), query.filename);
+             integral.regionHistogram(center, region_query.features.data());
+             std::vector<Document> results = tree.searchSimilar(region_query, TOP_K);
+             auto end_time = std::chrono::high_resolution_clock::now();
+             auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
+ 
+             int correct_count = 0;
+             resultsFile << "--- Method: Region Query (center half, K-d Tree) ---\n";
+             resultsFile << "Time: " << duration.count() << " us\n";
+             for(const auto& res : results){
+                 if(getCategory(res.filename) == queryCategory) correct_count++;
+             }
+             double precision = (double)correct_count / TOP_K * 100.0;
+             resultsFile << "Precision@" << TOP_K << ": " << precision << "%\n\n";
+         }
+ 
+         // --- Experiment 8: Earth Mover's Distance (L1 over cumulative histograms) ---
+         // The CDFs were computed at ingest, so EMD costs the same as an L1 scan or tree search.
+         {
+             DocumentList list(Metric::Manhattan);
+             KdTree tree(FEATURE_DIMENSIONS, Metric::Manhattan);
+             for(const auto& doc : cdf_docs) {
+                 if(doc.filename != query.filename) { list.insert(doc); tree.insert(doc); }
+             }
+ 
+             const std::pair<const char*, std::function<std::vector<Document>()>> methods[] = {
+                 {"EMD Sequential List", [&]() { return list.searchSimilar(cdf_query, TOP_K); }},
+                 {"EMD K-d Tree", [&]() { return tree.searchSimilar(cdf_query, TOP_K); }},
+             };
+             for (const auto& method : methods) {
+                 auto start_time = std::chrono::high_resolution_clock::now();
+                 std::vector<Document> results = method.second();
+                 auto end_time = std::chrono::high_resolution_clock::now();
+                 auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
+ 
+                 int correct_count = 0;
+                 resultsFile << "--- Method: " << method.first << " ---\n";
+                 resultsFile << "Time: " << duration.count() << " us\n";
+                 for(const auto& res : results){
+                     if(getCategory(res.filename) == queryCategory) correct_count++;
+                 }
+                 double precision = (double)correct_count / TOP_K * 100.0;
+                 resultsFile << "Precision@" << TOP_K << ": " << precision << "%\n\n";
+             }
+         }
+ 
+         // --- Experiment 9: Quadratic-Form Distance (Cholesky-transformed features, K-d Tree) ---
+         // Cross-bin similarity at the cost of a plain Euclidean search; the O(D^2) form is never evaluated.
+         if (!qf_docs.empty()) {
+             KdTree tree(FEATURE_DIMENSIONS);
+             for(const auto& doc : qf_docs) { if(doc.filename != query.filename) tree.insert(doc); }
+ 
+             auto start_time = std::chrono::high_resolution_clock::now();
+             std::vector<Document> results = tree.searchSimilar(qf_query, TOP_K);
+             auto end_time = std::chrono::high_resolution_clock::now();
+             auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
+ 
+             int correct_count = 0;
+             resultsFile << "--- Method: Quadratic-Form Distance (K-d Tree) ---\n";
+             resultsFile << "Time: " << duration.count() << " us\n";
+             for(const auto& res : results){
+                 if(getCategory(res.filename) == queryCategory) correct_count++;
+             }
+             double precision = (double)correct_count / TOP_K * 100.0;
+             resultsFile << "Precision@" << TOP_K << ": " << precision << "%\n\n";
+         }
+     }
+ 
+     //=========================================================================
+     // 3. LSH HASH FAMILY COMPARISON (recall vs. candidates per query)
+     //=========================================================================
+     {
+         resultsFile << "--------------------------------------\n";
+         resultsFile << "LSH HASH FAMILY COMPARISON\n";
+         resultsFile << "--------------------------------------\n";
+         resultsFile << "Recall@" << TOP_K << " against the exact neighbors of the sequential list,\n";
+         resultsFile << "averaged over the query images. Candidates = documents re-ranked per query.\n\n";
+ 
+         std::vector<Document> queries;
+         for (const auto& doc : all_docs) {
+             if (std::find(query_paths.begin(), query_paths.end(), doc.filename) != query_paths.end()) queries.push_back(doc);
+         }
+ 
+         // Every structure holds all documents, so the query itself is dropped from its results.
+         auto withoutQuery = [](std::vector<Document> results, const Document& query) {
+             results.erase(std::remove_if(results.begin(), results.end(), [&](const Document& d) {
+                 return d.filename == query.filename;
+             }), results.end());
+             if (results.size() > (size_t)TOP_K) results.resize(TOP_K);
+             return results;
+         };
+ 
+         DocumentList list;
+         for (const auto& doc : all_docs) list.insert(doc);
+         std::vector<std::vector<Document>> exact;
+         for (const auto& q : queries) exact.push_back(withoutQuery(list.searchSimilar(q, TOP_K + 1), q));
+ 
+         const std::pair<HashFamily, const char*> families[] = {
+             {HashFamily::GaussianProjection, "Gaussian projection"},
+             {HashFamily::E2LSH, "E2LSH (random offset)"},
+             {HashFamily::CrossPolytope, "Cross-polytope"},
+         };
+         for (const auto& family : families) {
+             resultsFile << "--- Family: " << family.second << " ---\n";
+             for (int nHashes : {1, 2, 4, 8, 16}) {
+                 DocumentHash lsh(FEATURE_DIMENSIONS, nHashes, 0.5, family.first, seed);
+                 for (const auto& doc : all_docs) lsh.insert(doc);
+ 
+                 double recall = 0.0, candidates = 0.0, micros = 0.0;
+                 for (size_t i = 0; i < queries.size(); ++i) {
+                     auto start = std::chrono::high_resolution_clock::now();
+                     std::vector<Document> found_docs = lsh.searchSimilar(queries[i], TOP_K + 1);
+                     micros += std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+                     std::vector<Document> results = withoutQuery(found_docs, queries[i]);
+                     int found = 0;
+                     for (const auto& res : results) {
+                         for (const auto& ex : exact[i]) { if (ex.id == res.id) { found++; break; } }
+                     }
+                     recall += exact[i].empty() ? 0.0 : (double)found / exact[i].size();
+                     candidates += lsh.candidateCount(queries[i]) - 1; // Minus the query itself.
+                 }
+                 if (!queries.empty()) { recall /= queries.size(); candidates /= queries.size(); micros /= queries.size(); }
+                 resultsFile << "Hashes: " << nHashes << " | Recall@" << TOP_K << ": " << recall * 100.0
+                             << "% | Candidates/query: " << candidates << " | Key bytes: " << nHashes * sizeof(int)
+                             << " | us/query: " << micros << "\n";
+             }
+             resultsFile << "\n";
+         }
+
+         // ITQ: learned binary codes; the 10 * K closest codes (found by a popcount scan or by
+         // multi-index hashing; both give the same Hamming neighbors up to ties) are re-ranked exactly.
+         resultsFile << "--- ITQ binary codes (" << 10 * TOP_K << " re-ranked) ---\n";
+         for (int bits : {8, 16, FEATURE_DIMENSIONS}) {
+             ItqIndex itq(FEATURE_DIMENSIONS, bits, 50, seed);
+             if (!itq.train(all_docs)) break;
+             for (const auto& doc : all_docs) itq.insert(doc);
+
+             for (bool multiIndex : {false, true}) {
+                 if (multiIndex) itq.useMultiIndex();
+                 double recall = 0.0, micros = 0.0;
+                 for (size_t i = 0; i < queries.size(); ++i) {
+                     auto start = std::chrono::high_resolution_clock::now();
+                     std::vector<Document> found_docs = itq.searchSimilar(queries[i], TOP_K + 1, 10 * TOP_K);
+                     micros += std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+                     std::vector<Document> results = withoutQuery(found_docs, queries[i]);
+                     int found = 0;
+                     for (const auto& res : results) {
+                         for (const auto& ex : exact[i]) { if (ex.id == res.id) { found++; break; } }
+                     }
+                     recall += exact[i].empty() ? 0.0 : (double)found / exact[i].size();
+                 }
+                 if (!queries.empty()) { recall /= queries.size(); micros /= queries.size(); }
+                 resultsFile << "Bits: " << bits << (multiIndex ? " | Multi-index" : " | Linear scan ") << " | Recall@" << TOP_K
+                             << ": " << recall * 100.0 << "% | Code bytes: " << itq.codeBytes() << " | us/query: " << micros << "\n";
+             }
+         }
+         resultsFile << "\n";
+     }
+ 
+     //=========================================================================
+     // 4. BATCHED QUERIES (norm-decomposed distance kernel)
+     //=========================================================================
+     if (!all_docs.empty()) {
+         resultsFile << "--------------------------------------\n";
+         resultsFile << "BATCHED QUERIES (every document as a query)\n";
+         resultsFile << "--------------------------------------\n";
+         DocumentList list;
+         for (const auto& doc : all_docs) list.insert(doc);
+ 
+         auto start = std::chrono::high_resolution_clock::now();
+         std::vector<std::vector<Document>> single;
+         for (const auto& doc : all_docs) single.push_back(list.searchSimilar(doc, TOP_K));
+         auto mid = std::chrono::high_resolution_clock::now();
+         std::vector<std::vector<Document>> batched = list.searchBatch(all_docs, TOP_K);
+         auto end = std::chrono::high_resolution_clock::now();
+ 
+         size_t agree = 0, total = 0;
+         for (size_t i = 0; i < single.size(); ++i) {
+             for (size_t j = 0; j < single[i].size() && j < batched[i].size(); ++j) agree += single[i][j].id == batched[i][j].id;
+             total += single[i].size();
+         }
+         resultsFile << "searchSimilar per query: " << std::chrono::duration_cast<std::chrono::microseconds>(mid - start).count() << " us\n";
+         resultsFile << "searchBatch: " << std::chrono::duration_cast<std::chrono::microseconds>(end - mid).count() << " us\n";
+         resultsFile << "Identical results: " << (total ? 100.0 * agree / total : 100.0) << "%\n";
+ 
+         // Accuracy and throughput of the kernel alone, on up to 256 queries.
+         FeatureBlocks blocks;
+         for (const auto& doc : all_docs) blocks.append(doc.features);
+         size_t nQueries = std::min<size_t>(256, all_docs.size());
+         std::vector<const float*> pointers;
+         for (size_t i = 0; i < nQueries; ++i) pointers.push_back(all_docs[i].features.data());
+         std::vector<float> squared(nQueries * all_docs.size());
+         start = std::chrono::high_resolution_clock::now();
+         blocks.batchSquaredDistances(pointers.data(), (int)nQueries, squared.data());
+         end = std::chrono::high_resolution_clock::now();
+         double maxError = 0.0;
+         for (size_t i = 0; i < nQueries; ++i) {
+             for (size_t d = 0; d < all_docs.size(); ++d) {
+                 double exact = euclideanDistance(all_docs[i].features, all_docs[d].features);
+                 maxError = std::max(maxError, std::abs(std::sqrt((double)squared[i * all_docs.size() + d]) - exact));
+             }
+         }
+         double micros = std::chrono::duration<double, std::micro>(end - start).count();
+         double flops = 2.0 * FEATURE_DIMENSIONS * nQueries * all_docs.size();
+         resultsFile << "Kernel: " << nQueries << " x " << all_docs.size() << " distances in " << micros << " us ("
+                     << (micros > 0 ? flops / micros / 1e3 : 0.0) << " GFLOP/s)\n";
+         resultsFile << "Max |kernel - euclideanDistance|: " << maxError << "\n\n";
+     }
+ 
+     //=========================================================================
+     // 5. TREE SEARCH VARIANTS (interleaved, packets, dual tree, compact nodes)
+     //=========================================================================
+     if (!all_docs.empty()) {
+         resultsFile << "--------------------------------------\n";
+         resultsFile << "TREE SEARCH VARIANTS (every document as a query)\n";
+         resultsFile << "--------------------------------------\n";
+         KdTree kdTree(FEATURE_DIMENSIONS);
+         CoverTree coverTree;
+         for (const auto& doc : all_docs) { kdTree.insert(doc); coverTree.insert(doc); }
+
+         const std::pair<const char*, std::function<std::vector<Document>(const Document&)>> single[] = {
+             {"K-d Tree", [&](const Document& q) { return kdTree.searchSimilar(q, TOP_K); }},
+             {"Cover Tree", [&](const Document& q) { return coverTree.searchSimilar(q, TOP_K); }},
+         };
+         const std::function<std::vector<std::vector<Document>>(int)> batched[] = {
+             [&](int inFlight) { return kdTree.searchBatch(all_docs, TOP_K, inFlight); },
+             [&](int inFlight) { return coverTree.searchBatch(all_docs, TOP_K, inFlight); },
+         };
+         auto sameIds = [](const std::vector<std::vector<Document>>& a, const std::vector<std::vector<Document>>& b) {
+             for (size_t i = 0; i < a.size(); ++i) {
+                 if (a[i].size() != b[i].size()) return false;
+                 for (size_t j = 0; j < a[i].size(); ++j) if (a[i][j].id != b[i][j].id) return false;
+             }
+             return true;
+         };
+         // For structures that may order equal distances differently.
+         auto sameDistances = [&](const std::vector<std::vector<Document>>& a, const std::vector<std::vector<Document>>& b) {
+             for (size_t i = 0; i < a.size(); ++i) {
+                 if (a[i].size() != b[i].size()) return false;
+                 for (size_t j = 0; j < a[i].size(); ++j) {
+                     if (euclideanDistance(all_docs[i].features, a[i][j].features) != euclideanDistance(all_docs[i].features, b[i][j].features)) return false;
+                 }
+             }
+             return true;
+         };
+         for (int t = 0; t < 2; ++t) {
+             auto start = std::chrono::high_resolution_clock::now();
+             std::vector<std::vector<Document>> expected;
+             for (const auto& doc : all_docs) expected.push_back(single[t].second(doc));
+             auto end = std::chrono::high_resolution_clock::now();
+             resultsFile << "--- " << single[t].first << " ---\n";
+             resultsFile << "searchSimilar per query: " << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() << " us\n";
+
+             for (int inFlight : {1, 4, 8, 16, 32}) {
+                 start = std::chrono::high_resolution_clock::now();
+                 std::vector<std::vector<Document>> results = batched[t](inFlight);
+                 end = std::chrono::high_resolution_clock::now();
+                 resultsFile << "searchBatch, " << inFlight << " in flight: "
+                             << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() << " us"
+                             << (sameIds(results, expected) ? "" : " (RESULTS DIFFER)") << "\n";
+             }
+             if (t == 0) {
+                 start = std::chrono::high_resolution_clock::now();
+                 std::vector<std::vector<Document>> results = kdTree.searchPacket(all_docs, TOP_K);
+                 end = std::chrono::high_resolution_clock::now();
+                 resultsFile << "searchPacket, " << KD_PACKET_SIZE << " queries per packet: "
+                             << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() << " us"
+                             << (sameIds(results, expected) ? "" : " (RESULTS DIFFER)") << "\n";
+
+                 // The dual-tree search may order equal distances differently.
+                 DualTreeKnn dualTree;
+                 start = std::chrono::high_resolution_clock::now();
+                 dualTree.build(all_docs);
+                 auto built = std::chrono::high_resolution_clock::now();
+                 results = dualTree.search(all_docs, TOP_K);
+                 end = std::chrono::high_resolution_clock::now();
+                 resultsFile << "Dual-tree search: " << std::chrono::duration_cast<std::chrono::microseconds>(end - built).count()
+                             << " us (+ " << std::chrono::duration_cast<std::chrono::microseconds>(built - start).count()
+                             << " us corpus tree build)" << (sameDistances(results, expected) ? "" : " (RESULTS DIFFER)") << "\n";
+
+                 // A different tree over the same documents, also checked by distance.
+                 CompactKdTree compactTree;
+                 start = std::chrono::high_resolution_clock::now();
+                 compactTree.build(all_docs);
+                 built = std::chrono::high_resolution_clock::now();
+                 results.clear();
+                 for (const auto& doc : all_docs) results.push_back(compactTree.searchSimilar(doc, TOP_K));
+                 end = std::chrono::high_resolution_clock::now();
+                 resultsFile << "Compact K-d Tree (" << sizeof(CompactKdNode) << "-byte nodes, " << compactTree.nodeBytes()
+                             << " bytes), per query: " << std::chrono::duration_cast<std::chrono::microseconds>(end - built).count()
+                             << " us (+ " << std::chrono::duration_cast<std::chrono::microseconds>(built - start).count()
+                             << " us build)" << (sameDistances(results, expected) ? "" : " (RESULTS DIFFER)") << "\n";
+             }
+         }
+         resultsFile << "\n";
+     }
+
+     //=========================================================================
+     // 6. PAGE SIZE BENCHMARK (only with --page-benchmark)
+     //=========================================================================
+     if (page_benchmark) {
+         // 2M synthetic documents: 192 MB of features, far beyond the last-level cache.
+         const size_t CORPUS_SIZE = 2000000;
+         const size_t ACCESSES = 2000000;
+         resultsFile << "--------------------------------------\n";
+         resultsFile << "PAGE SIZE BENCHMARK (" << CORPUS_SIZE << " synthetic documents, "
+                     << ACCESSES << " random block distances)\n";
+         resultsFile << "--------------------------------------\n";
+ 
+         PagePolicy previous = pagePolicy();
+         std::vector<float> query(FEATURE_DIMENSIONS, 1.0f / FEATURE_DIMENSIONS);
+         for (PagePolicy policy : {PagePolicy::System, PagePolicy::Standard, PagePolicy::Transparent, PagePolicy::Explicit}) {
+             setPagePolicy(policy);
+             size_t hugeBefore = residentHugePageBytes();
+             FeatureBlocks blocks;
+             std::mt19937 gen(seed);
+             std::uniform_real_distribution<float> value(0.0f, 1.0f);
+             std::vector<float> features(FEATURE_DIMENSIONS);
+             for (size_t i = 0; i < CORPUS_SIZE; ++i) {
+                 for (auto& f : features) f = value(gen);
+                 blocks.append(features);
+             }
+             size_t hugeAfter = residentHugePageBytes();
+ 
+             // Blocks at random positions, as when re-ranking candidates scattered over the corpus.
+             std::uniform_int_distribution<size_t> pick(0, blocks.blocks() - 1);
+             std::vector<size_t> order(ACCESSES);
+             for (auto& b : order) b = pick(gen);
+             float out[FeatureBlocks::LANES];
+             float sink = 0.0f;
+             TlbMissCounter tlb;
+             tlb.start();
+             auto start = std::chrono::high_resolution_clock::now();
+             for (size_t b : order) {
+                 blocks.blockDistances(Metric::Euclidean, query.data(), b, out);
+                 sink += out[0];
+             }
+             auto end = std::chrono::high_resolution_clock::now();
+             long long misses = tlb.stop();
+ 
+             resultsFile << "--- " << pagePolicyName(policy) << " ---\n";
+             resultsFile << "Huge pages resident: " << (hugeAfter > hugeBefore ? (hugeAfter - hugeBefore) >> 20 : 0) << " MB"
+                         << " | ns/access: " << std::chrono::duration<double, std::nano>(end - start).count() / ACCESSES
+                         << " | dTLB misses/access: ";
+             if (misses < 0) resultsFile << "n/a";
+             else resultsFile << (double)misses / ACCESSES;
+             resultsFile << " (checksum " << sink << ")\n";
+         }
+         setPagePolicy(previous);
+         resultsFile << "\n";
+     }
+
+     //=========================================================================
+     // 7. NODE LAYOUT BENCHMARK (only with --layout-benchmark)
+     //=========================================================================
+     if (layout_benchmark) {
+         // Synthetic documents on a 4-dimensional subspace, so the tree prunes as it
+         // does on real histograms instead of degenerating into a scan.
+         const int LATENT_DIMENSIONS = 4;
+         const int QUERIES = 10000;
+         resultsFile << "--------------------------------------\n";
+         resultsFile << "NODE LAYOUT BENCHMARK (compact kd-tree, " << QUERIES << " queries per size)\n";
+         resultsFile << "--------------------------------------\n";
+
+         std::mt19937 gen(seed);
+         std::normal_distribution<float> normal(0.0f, 1.0f);
+         std::vector<std::vector<float>> basis(LATENT_DIMENSIONS, std::vector<float>(FEATURE_DIMENSIONS));
+         for (auto& row : basis) for (auto& v : row) v = normal(gen);
+         auto synthetic = [&](int id) {
+             Document doc(id, std::vector<float>(FEATURE_DIMENSIONS, 0.0f));
+             for (int i = 0; i < LATENT_DIMENSIONS; ++i) {
+                 float z = normal(gen);
+                 for (int j = 0; j < FEATURE_DIMENSIONS; ++j) doc.features[j] += z * basis[i][j];
+             }
+             return doc;
+         };
+         std::vector<Document> queries;
+         for (int i = 0; i < QUERIES; ++i) queries.push_back(synthetic(-1));
+
+         const std::pair<NodeLayout, const char*> layouts[] = {
+             {NodeLayout::DepthFirst, "DFS"},
+             {NodeLayout::BreadthFirst, "BFS"},
+             {NodeLayout::VanEmdeBoas, "vEB"},
+         };
+         for (size_t corpusSize : {10000, 100000, 1000000}) {
+             std::vector<Document> corpus;
+             for (size_t i = 0; i < corpusSize; ++i) corpus.push_back(synthetic((int)i));
+             // Leaves of one document make the node array, not the leaf scans, the working set.
+             for (int leafSize : {1, 8}) {
+                 CompactKdTree tree(Metric::Euclidean, leafSize);
+                 tree.build(corpus);
+                 resultsFile << corpusSize << " documents, leaf size " << leafSize << " (" << (tree.nodeBytes() >> 10) << " KB of nodes):";
+                 for (const auto& layout : layouts) {
+                     tree.setLayout(layout.first);
+                     auto start = std::chrono::high_resolution_clock::now();
+                     size_t found = 0;
+                     for (const auto& q : queries) found += tree.searchSimilar(q, TOP_K).size();
+                     auto end = std::chrono::high_resolution_clock::now();
+                     resultsFile << " | " << layout.second << " "
+                                 << std::chrono::duration<double, std::micro>(end - start).count() / QUERIES << " us/query";
+                     if (found != (size_t)QUERIES * std::min<size_t>(TOP_K, corpusSize)) resultsFile << " (INCOMPLETE)";
+                 }
+                 resultsFile << "\n";
+             }
+         }
+         resultsFile << "\n";
      }
  
      resultsFile.close();